@@ -0,0 +1,2928 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * DRM driver for NumWorks SPI framebuffer display
+ *
+ * The NumWorks calculator's STM32 acts as an SPI slave that receives
+ * raw RGB565 pixels and DMA-transfers them directly to the LCD.
+ * No init commands, no MIPI DBI protocol — just raw pixel data.
+ *
+ * This is a DRM/KMS driver using drm_simple_display_pipe, which means:
+ *   - KMS composites directly to this display (no fbcp needed)
+ *   - Works with Wayland, X11, and fbcon
+ *   - Proper modern Linux graphics stack
+ *
+ * Uses async SPI with double buffering: CPU scales frame N+1 into one
+ * buffer while SPI DMA sends frame N from the other. This overlaps
+ * CPU and SPI work, achieving the SPI bus speed limit (~50 FPS). Only
+ * the output a frame's damage reaches is converted; each buffer tracks
+ * what it missed while the other one was being written.
+ *
+ * Conversion and submission run in a worker, not in the atomic commit:
+ * a commit only queues its framebuffer and damage and returns, so the
+ * compositor never waits for the bus. The worker always takes the
+ * newest queued frame; older ones are dropped with their damage merged.
+ *
+ * There is no scanout to sync to, so vblank is emulated: the end of each
+ * SPI transfer is the moment a new frame is on the LCD. While the bus
+ * is idle an hrtimer ticks at the rate full frames would go out, so
+ * page-flip events still complete and clients pace to the bus.
+ *
+ * The cursor plane has no scanout either: the worker blends it over the
+ * converted output, so moving the pointer reconverts the few rows it
+ * crosses and the compositor never repaints the primary plane for it.
+ * The YUV overlay plane is drawn the same way, under the cursor, so a
+ * camera viewfinder reaches the LCD without the compositor or the GPU.
+ *
+ * CRTC colour management (degamma, CTM, gamma) is folded into a single
+ * lookup table, applied to the output as it is converted, so night
+ * light costs the compositor nothing.
+ *
+ * Inspired by zardam's SPI display concept.
+ * Based on drivers/gpu/drm/tiny/repaper.c skeleton pattern.
+ */
+
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/iosys-map.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/property.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spi/spi.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/xxhash.h>
+
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_atomic_state_helper.h>
+#include <drm/drm_color_mgmt.h>
+#include <drm/drm_connector.h>
+#include <drm/drm_damage_helper.h>
+#include <drm/drm_debugfs.h>
+#include <drm/drm_drv.h>
+#include <drm/drm_fb_dma_helper.h>
+#include <drm/drm_fbdev_dma.h>
+#include <drm/drm_format_helper.h>
+#include <drm/drm_framebuffer.h>
+#include <drm/drm_gem_dma_helper.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_managed.h>
+#include <drm/drm_modeset_helper_vtables.h>
+#include <drm/drm_probe_helper.h>
+#include <drm/drm_property.h>
+#include <drm/drm_simple_kms_helper.h>
+#include <drm/drm_vblank.h>
+
+#include "drm-spifb-pixel.h"
+#include "drm-spifb-stats.h"
+#include "drm-spifb-wire.h"
+
+#define CREATE_TRACE_POINTS
+#include "drm-spifb-trace.h"
+
+#define DRIVER_NAME	"drm-spifb"
+#define DRIVER_DESC	"NumWorks SPI framebuffer display"
+
+/*
+ * SPI frame size. The BCM2835 DMA engine supports transfers up to 1GB,
+ * so we send the entire frame in a single transfer to minimize overhead.
+ * Previous 32KB chunking added ~2ms DMA setup overhead per frame.
+ * Zero-copy sends put their 16-byte v2 header in a transfer of its own,
+ * which the controller sends by PIO without DMA setup.
+ */
+#define FRAME_SIZE	(320 * 240 * 2)	/* 153,600 bytes RGB565 */
+#define MAX_SPI_XFERS	2
+
+/* One conversion band per Cortex-A53 on the Pi Zero 2W */
+#define MAX_CONV_BANDS	4
+#define MIN_BAND_ROWS	16		/* Smallest band worth a CPU */
+
+#define MAX_STREAM_CHUNKS	8
+
+/*
+ * Fixed cost of one SPI message on the bcm2835 (CS, FIFO and DMA setup),
+ * on top of the bits themselves. Measured: see performance-investigation.md.
+ */
+#define SPI_XFER_OVERHEAD_NS	(2400 * NSEC_PER_USEC)
+
+/*
+ * Converted output is hashed in this many horizontal bands (15 rows
+ * each at 240 lines). A downscaled frame often comes out identical to
+ * the one already on the LCD, e.g. when a caret blinks off and on
+ * between two commits or a window moves by less than a source pixel.
+ */
+#define HASH_BANDS	16
+
+/* Overlay scaling limits, as src/dst ratios: up to 16x up and 4x down */
+#define OVERLAY_MIN_SCALE	(DRM_PLANE_NO_SCALING / 16)
+#define OVERLAY_MAX_SCALE	(DRM_PLANE_NO_SCALING * 4)
+
+/*
+ * Virtual resolutions the connector offers, on top of the DT default
+ * and the DT 'virtual-modes' list. Switching between them is a plain
+ * modeset: the scaler tables are rebuilt on enable, and staging and
+ * scratch are sized for the largest mode up front.
+ */
+#define MAX_VMODES	10
+#define MAX_VSCALE	4		/* Largest virtual/physical ratio... */
+#define MAX_VUPSCALE	2		/* ...and physical/virtual one */
+
+/* CRTC colour properties, in the order DRM applies them */
+enum nw_spifb_colour_prop {
+	NW_SPIFB_DEGAMMA,
+	NW_SPIFB_CTM,
+	NW_SPIFB_GAMMA,		/* Also the C8 palette */
+	NW_SPIFB_COLOUR_PROPS,
+};
+
+struct nw_spifb_vmode {
+	u32 width;
+	u32 height;
+};
+
+static const struct nw_spifb_vmode nw_spifb_default_vmodes[] = {
+	{ 160, 120 },	/* Upscaled 2x: a quarter of the pixels to render */
+	{ 240, 180 },
+	{ 320, 240 },	/* 1:1, cheapest for games */
+	{ 400, 300 },
+	{ 480, 360 },
+	{ 640, 480 },
+};
+
+/*
+ * The compositor framebuffer is dma_alloc_wc() memory: uncached on the
+ * Pi, so the scaler's scattered per-pixel loads each go to DRAM. With
+ * staging enabled the damaged rows are first streamed into a cached
+ * buffer with burst reads and the scaler runs on that copy instead.
+ * Imported (PRIME) buffers are staged either way.
+ */
+static bool staging = true;
+module_param(staging, bool, 0644);
+MODULE_PARM_DESC(staging, "Copy damaged rows to a cached buffer before scaling (default: true)");
+
+/*
+ * Nearest-neighbour drops whole source rows and columns, which makes
+ * text shimmer when downscaling. The box filter averages them instead;
+ * its 3:2 and 2:1 paths are NEON-accelerated. Upscaled modes (160x120,
+ * 240x180) come out blocky with nearest and smooth with box, which
+ * interpolates bilinearly there.
+ */
+static uint filter = NW_SPIFB_FILTER_NEAREST;
+module_param(filter, uint, 0644);
+MODULE_PARM_DESC(filter, "Scaling filter: 0 = nearest, 1 = box (default: 0)");
+
+/*
+ * Conversion is split into this many horizontal bands, converted in
+ * parallel on as many CPUs and joined before the frame is sent. 1 keeps
+ * everything on the worker's CPU.
+ */
+static uint bands = 1;
+module_param(bands, uint, 0644);
+MODULE_PARM_DESC(bands, "Convert in this many bands on separate CPUs (1-4, default: 1)");
+
+/*
+ * v1 frames can be sent in this many chunks of rows, each queued as
+ * soon as it is converted, so the bus is busy while the CPU converts
+ * the rest. CS stays asserted between chunks. A streamed frame is sent
+ * before it is known whether it differs from the LCD, so unchanged
+ * frames are not skipped.
+ */
+static uint stream = 1;
+module_param(stream, uint, 0644);
+MODULE_PARM_DESC(stream, "Send v1 frames in this many chunks while converting (1-8, default: 1 = off)");
+
+/*
+ * v2 payload encoding. Flat desktop and terminal content shrinks a lot
+ * under RLE; anything that does not shrink is sent raw. Needs v2 and
+ * calculator firmware that decodes it.
+ */
+static uint compress = NW_SPIFB_ENC_RAW;
+module_param(compress, uint, 0644);
+MODULE_PARM_DESC(compress, "v2 wire encoding: 0 = raw, 1 = RLE, 2 = XOR delta + RLE (default: 0)");
+
+/*
+ * At 1:1, RGB565 framebuffers can go out without any CPU pass: the SPI
+ * DMA reads the damaged rows straight from the GEM buffer, announced as
+ * little-endian raw. Full-screen games rendering 320x240 then cost no
+ * CPU time in the driver. Needs v2 and calculator firmware that swaps
+ * the bytes (the bcm2835 SPI controller only does 8-bit words).
+ */
+static bool zerocopy;
+module_param(zerocopy, bool, 0644);
+MODULE_PARM_DESC(zerocopy, "Send 1:1 RGB565 framebuffers unconverted, needs v2 (default: false)");
+
+/*
+ * Interlaced updates: each v2 transfer carries only the odd or only the
+ * even rows of its window, alternating, so moving content goes out at
+ * twice the rate for the same bus time. The rows a field leaves out
+ * follow in the next transfer, straight after the current one if no
+ * new frame comes, so still content is complete two fields on. Needs
+ * v2 and calculator firmware that understands field messages.
+ */
+static bool field;
+module_param(field, bool, 0644);
+MODULE_PARM_DESC(field, "Send alternate rows on each transfer (interlaced), needs v2 (default: false)");
+
+/*
+ * With an 8-bit wire (DT 'wire-depth = <8>'), each pixel's reduction to
+ * RGB332 is ordered-dithered, so gradients and photos keep their tone
+ * at the cost of a fine pattern. Off, every pixel rounds to the nearest
+ * level, which suits flat UI colours and pixel art.
+ */
+static bool dither = true;
+module_param(dither, bool, 0644);
+MODULE_PARM_DESC(dither, "Ordered dither on an 8-bit wire (default: true)");
+
+struct nw_spifb;
+
+/*
+ * Cursor and overlay plane state. The CRTC check pulls the primary plane
+ * into every commit on the CRTC, with no damage clips, so a pointer move
+ * or a new video frame would otherwise read as a full repaint of it.
+ */
+struct nw_spifb_plane_state {
+	struct drm_plane_state base;
+	bool primary_idle;		/* Commit did not touch the primary */
+};
+
+static inline struct nw_spifb_plane_state *
+to_nw_plane_state(struct drm_plane_state *state)
+{
+	return container_of(state, struct nw_spifb_plane_state, base);
+}
+
+/* One horizontal band of a frame's conversion, and its CPU's scratch */
+struct nw_spifb_band {
+	struct work_struct work;
+	struct nw_spifb *nw;
+	struct drm_rect rect;		/* Output pixels */
+	void *scratch;			/* Scaler rows */
+	struct drm_format_conv_state fmtcnv_state;	/* 1:1 helpers */
+};
+
+struct nw_spifb {
+	struct drm_device drm;
+	struct spi_device *spi;
+	struct drm_simple_display_pipe pipe;
+	struct drm_connector connector;
+
+	u32 width;		/* Physical SPI display width (320) */
+	u32 height;		/* Physical SPI display height (240) */
+	u32 vwidth;		/* Virtual (compositor) width... */
+	u32 vheight;		/* ...and height of the current mode */
+
+	/* Modes on offer, the DT default first, and the largest of them */
+	struct nw_spifb_vmode vmodes[MAX_VMODES];
+	u32 num_vmodes;
+	u32 max_vwidth;
+	u32 max_vheight;
+
+	/* Scaler coordinate tables, rebuilt for each mode */
+	struct nw_spifb_scaler scaler;
+	u16 *scaler_tables;
+
+	/*
+	 * Conversion of the frame being prepared, shared by its bands:
+	 * scaled from conv_src, or converted 1:1 from conv_map/conv_fb.
+	 */
+	struct nw_spifb_band band[MAX_CONV_BANDS];
+	bool conv_scaled;
+	struct nw_spifb_src conv_src;
+	const struct iosys_map *conv_map;
+	const struct drm_framebuffer *conv_fb;
+	u32 conv_format;
+
+	/* Colours of 8-bit framebuffers: C8 from the gamma LUT, or fixed */
+	struct nw_spifb_palette c8_palette;
+	struct nw_spifb_palette rgb332_palette;
+	struct nw_spifb_palette grey_palette;
+
+	/*
+	 * Colour management of every other format, folded into a table
+	 * the converted output goes through (colour_active false while it
+	 * is the identity). colour is where the table is built from.
+	 */
+	struct nw_spifb_colour colour;
+	u16 *colour_table;
+	bool colour_active;
+
+	/*
+	 * Cursor plane, blended over the output after conversion: a
+	 * cached copy of its image, and where it is blended (argb NULL
+	 * while hidden).
+	 */
+	struct drm_plane cursor_plane;
+	u32 cursor_argb[NW_SPIFB_CURSOR_MAX * NW_SPIFB_CURSOR_MAX];
+	struct nw_spifb_cursor cursor;
+
+	/*
+	 * YUV overlay plane, drawn over the output before the cursor. Its
+	 * framebuffer is referenced while shown (NULL while hidden) and
+	 * mapped into overlay.plane[] for each frame.
+	 */
+	struct drm_plane overlay_plane;
+	struct nw_spifb_overlay overlay;
+	struct drm_framebuffer *overlay_fb;
+	struct drm_rect overlay_damage;	/* Source area to convert again */
+
+	/* Cached copy of the compositor framebuffer (see 'staging' param) */
+	void *staging;
+	u32 staging_pitch;
+	u32 staging_format;		/* Format staged rows are in, 0 = none */
+
+	/* Per-band xxh64 of the last frame sent, valid once one has been */
+	u64 band_hash[HASH_BANDS];
+	bool band_hash_valid;
+
+	/*
+	 * Latest-frame-wins mailbox between commits and the worker. The
+	 * queued framebuffer is referenced until the worker is done.
+	 */
+	struct work_struct work;
+	spinlock_t pending_lock;
+	struct drm_framebuffer *pending_fb;
+	struct drm_rect pending_damage;	/* Merged since the last pickup */
+	bool pending_full;		/* Resend everything (after enable) */
+	ktime_t pending_time;		/* Commit time of the queued frame */
+	/* Colour management to load if set, NULL blobs meaning none */
+	struct drm_property_blob *pending_colour[NW_SPIFB_COLOUR_PROPS];
+	bool pending_colour_set;
+	bool pending_colour_c8;		/* Set along with a C8 framebuffer */
+	struct nw_spifb_cursor pending_cursor;	/* Cursor to blend next... */
+	struct drm_framebuffer *pending_cursor_fb;	/* ...image to load... */
+	bool pending_cursor_set;	/* ...if set */
+	struct nw_spifb_overlay pending_overlay;	/* Overlay to show next... */
+	struct drm_framebuffer *pending_overlay_fb;	/* ...from this, NULL hidden... */
+	bool pending_overlay_set;	/* ...if set */
+
+	/* Frame counters, reported in debugfs 'stats' */
+	unsigned long frames_sent;
+	unsigned long frames_skipped;
+	unsigned long frames_dropped;	/* Superseded before conversion */
+	atomic64_t bytes_sent;		/* 64-bit, so atomic on 32-bit ARM too */
+	unsigned long enc_frames[NW_SPIFB_ENCODINGS];	/* v2 messages per encoding */
+	unsigned long fields_sent;	/* ...of which field messages */
+
+	/* Per-phase timing, also in debugfs 'stats' */
+	spinlock_t stats_lock;		/* Completion adds from IRQ context */
+	struct nw_spifb_hist hist[NW_SPIFB_PHASES];
+	u64 frame_seq;			/* Frames picked up by the worker */
+
+	/* v2 wire format: windowed updates (DT 'partial-update') */
+	bool partial;
+	bool rgb332;			/* 8-bit pixels (DT 'wire-depth') */
+	void *wire_buf[2];		/* Encoded message per TX buffer */
+	struct nw_spifb_wire_hdr *zc_hdr;	/* Header of zero-copy sends */
+
+	/*
+	 * Field mode (see 'field' param): the LCD is behind on the rows of
+	 * field_owed with parity field_parity, which the next field sends.
+	 * field_followup has the SPI completion requeue the worker for
+	 * them, unless field_stop says the pipe is going down.
+	 */
+	struct drm_rect field_owed;
+	u32 field_parity;
+	bool field_followup;
+	bool field_stop;
+
+	/* Double-buffered async SPI */
+	void *tx_buf[2];
+	int tx_write;			/* Buffer index CPU writes to next */
+	struct drm_rect tx_stale[2];	/* Output each buffer is behind on */
+	struct spi_message tx_msg;
+	struct spi_transfer tx_xfers[MAX_SPI_XFERS];
+	struct spi_message stream_msg[MAX_STREAM_CHUNKS];
+	struct spi_transfer stream_xfer[MAX_STREAM_CHUNKS];
+	struct spi_message *tx_last;	/* Message that completes the frame */
+	struct completion tx_done;	/* Signals SPI transfer complete */
+	struct drm_framebuffer *tx_fb;	/* Zero-copy source being read */
+	u64 tx_seq;			/* Frame in flight... */
+	ktime_t tx_start;		/* ...when spi_async() took it... */
+	ktime_t tx_commit;		/* ...and when it was committed */
+
+	/* Last frame converted and sent, for debugfs 'converted' */
+	struct mutex capture_lock;	/* Held across TX buffer flips */
+	u64 sent_seq;			/* Frame in tx_buf[!tx_write], 0 = none */
+
+	/* Vblank emulation: SPI completions, or the timer while idle */
+	struct hrtimer vblank_timer;
+	u32 frame_ns;			/* Full frame time on the bus */
+	bool vblank_on;
+};
+
+static inline struct nw_spifb *drm_to_nw(struct drm_device *drm)
+{
+	return container_of(drm, struct nw_spifb, drm);
+}
+
+/*
+ * Copy the damaged rectangle of the compositor framebuffer into the
+ * staging buffer. Each row is one contiguous memcpy(), which the ARM
+ * string routines turn into 32-byte LDM bursts: the only access pattern
+ * that is tolerable on write-combined memory. Rows outside the damage
+ * keep the contents staged by earlier frames.
+ */
+static void nw_spifb_stage_rect(struct nw_spifb *nw,
+				const struct iosys_map *src,
+				const struct drm_framebuffer *fb,
+				const struct drm_rect *rect)
+{
+	u32 cpp = fb->format->cpp[0];
+	size_t len = drm_rect_width(rect) * cpp;
+	const u8 *s = (const u8 *)src->vaddr + rect->y1 * fb->pitches[0] +
+		      rect->x1 * cpp;
+	u8 *d = (u8 *)nw->staging + rect->y1 * nw->staging_pitch +
+		rect->x1 * cpp;
+	int y;
+
+	for (y = rect->y1; y < rect->y2; y++) {
+		memcpy(d, s, len);
+		s += fb->pitches[0];
+		d += nw->staging_pitch;
+	}
+}
+
+/* Convert the band's output pixels of the current frame into the TX buffer */
+static void nw_spifb_convert_band(struct nw_spifb_band *band)
+{
+	struct nw_spifb *nw = band->nw;
+	const struct drm_rect *clip = &band->rect;
+	u16 *tx = nw->tx_buf[nw->tx_write];
+	unsigned int pitch = nw->width * 2;
+	struct iosys_map dst;
+
+	if (nw->conv_scaled) {
+		nw_spifb_scale_rect(&nw->scaler, &nw->conv_src, tx, clip->x1,
+				    clip->y1, clip->x2, clip->y2, band->scratch);
+		return;
+	}
+
+	/* The helpers write the clip to the start of @dst */
+	iosys_map_set_vaddr(&dst, tx + clip->y1 * nw->width + clip->x1);
+
+	/*
+	 * No staging needed here: the helpers already copy each source
+	 * line into a cached temporary before converting.
+	 */
+	switch (nw->conv_format) {
+	case DRM_FORMAT_RGB565:
+		drm_fb_swab(&dst, &pitch, nw->conv_map, nw->conv_fb, clip, false,
+			    &band->fmtcnv_state);
+		break;
+	case DRM_FORMAT_XRGB8888:
+		drm_fb_xrgb8888_to_rgb565(&dst, &pitch, nw->conv_map, nw->conv_fb,
+					  clip, &band->fmtcnv_state, true);
+		break;
+	}
+}
+
+static void nw_spifb_band_work(struct work_struct *work)
+{
+	nw_spifb_convert_band(container_of(work, struct nw_spifb_band, work));
+}
+
+/*
+ * Convert output rectangle @rect as set up in nw->conv_*, split into
+ * 'bands' horizontal bands: the first on this CPU, the others queued on
+ * the next online CPUs. Returns once all of them are done.
+ */
+static void nw_spifb_convert_rect(struct nw_spifb *nw,
+				  const struct drm_rect *rect)
+{
+	u32 height = drm_rect_height(rect);
+	u32 n = clamp(READ_ONCE(bands), 1U,
+		      min_t(u32, MAX_CONV_BANDS, num_online_cpus()));
+	u32 rows, i;
+	int cpu = raw_smp_processor_id();
+
+	/* A cursor blink is not worth waking other CPUs for */
+	n = min(n, DIV_ROUND_UP(height, MIN_BAND_ROWS));
+	rows = DIV_ROUND_UP(height, n);
+
+	for (i = 0; i < n; i++) {
+		nw->band[i].rect = *rect;
+		nw->band[i].rect.y1 = min(rect->y1 + i * rows, rect->y2);
+		nw->band[i].rect.y2 = min(rect->y1 + (i + 1) * rows, rect->y2);
+	}
+
+	for (i = 1; i < n; i++) {
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		queue_work_on(cpu, system_highpri_wq, &nw->band[i].work);
+	}
+
+	nw_spifb_convert_band(&nw->band[0]);
+
+	for (i = 1; i < n; i++)
+		flush_work(&nw->band[i].work);
+}
+
+/* Output rectangle that source rectangle @src can change */
+static void nw_spifb_output_rect(struct nw_spifb *nw,
+				 const struct drm_rect *src,
+				 struct drm_rect *out)
+{
+	u32 x1, y1, x2, y2;
+
+	nw_spifb_scaler_span(src->x1, src->x2, nw->vwidth, nw->width,
+			     &x1, &x2);
+	nw_spifb_scaler_span(src->y1, src->y2, nw->vheight, nw->height,
+			     &y1, &y2);
+	*out = DRM_RECT_INIT(x1, y1, x2 - x1, y2 - y1);
+}
+
+/*
+ * Source rectangle the cursor covers, clipped to the frame. Returns
+ * false if it is hidden or entirely off-screen.
+ */
+static bool nw_spifb_cursor_rect(struct nw_spifb *nw, struct drm_rect *rect)
+{
+	struct drm_rect full = DRM_RECT_INIT(0, 0, nw->vwidth, nw->vheight);
+	const struct nw_spifb_cursor *cur = &nw->cursor;
+
+	if (!cur->argb)
+		return false;
+
+	*rect = DRM_RECT_INIT(cur->x, cur->y, cur->width, cur->height);
+
+	return drm_rect_intersect(rect, &full);
+}
+
+/* Grow @rect to cover @add as well; either may be empty */
+static void nw_spifb_rect_union(struct drm_rect *rect,
+				const struct drm_rect *add)
+{
+	if (!drm_rect_visible(add))
+		return;
+	if (!drm_rect_visible(rect)) {
+		*rect = *add;
+		return;
+	}
+
+	rect->x1 = min(rect->x1, add->x1);
+	rect->y1 = min(rect->y1, add->y1);
+	rect->x2 = max(rect->x2, add->x2);
+	rect->y2 = max(rect->y2, add->y2);
+}
+
+/*
+ * Output rectangle the overlay replaces. Returns false if it is hidden
+ * or its framebuffer is not mapped for this frame.
+ */
+static bool nw_spifb_overlay_rect(struct nw_spifb *nw, struct drm_rect *rect)
+{
+	u32 x0, y0, x1, y1;
+
+	if (!nw->overlay.plane[0] ||
+	    !nw_spifb_overlay_span(&nw->scaler, &nw->overlay, &x0, &y0, &x1, &y1))
+		return false;
+
+	*rect = DRM_RECT_INIT(x0, y0, x1 - x0, y1 - y0);
+
+	return true;
+}
+
+/*
+ * Convert output rectangle @rect except for @hole, which lies within
+ * it: the rows above and below it, then the columns either side.
+ */
+static void nw_spifb_convert_around(struct nw_spifb *nw,
+				    const struct drm_rect *rect,
+				    const struct drm_rect *hole)
+{
+	struct drm_rect piece[] = {
+		DRM_RECT_INIT(rect->x1, rect->y1, drm_rect_width(rect),
+			      hole->y1 - rect->y1),
+		DRM_RECT_INIT(rect->x1, hole->y2, drm_rect_width(rect),
+			      rect->y2 - hole->y2),
+		DRM_RECT_INIT(rect->x1, hole->y1, hole->x1 - rect->x1,
+			      drm_rect_height(hole)),
+		DRM_RECT_INIT(hole->x2, hole->y1, rect->x2 - hole->x2,
+			      drm_rect_height(hole)),
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(piece); i++)
+		if (drm_rect_visible(&piece[i]))
+			nw_spifb_convert_rect(nw, &piece[i]);
+}
+
+/*
+ * Convert what the write buffer is behind on within output rows
+ * @y0..@y1. Everything else in it already shows the current frame.
+ */
+static void nw_spifb_convert_stale(struct nw_spifb *nw, u32 y0, u32 y1)
+{
+	struct drm_rect rect = nw->tx_stale[nw->tx_write];
+	u16 *tx = nw->tx_buf[nw->tx_write];
+	struct drm_rect overlay, cursor;
+
+	rect.y1 = max_t(int, rect.y1, y0);
+	rect.y2 = min_t(int, rect.y2, y1);
+	if (!drm_rect_visible(&rect))
+		return;
+
+	/*
+	 * The 3:2 and 1:2 kernels convert even column bounds whatever
+	 * they are asked for, so the overlay, cursor and colour passes
+	 * must cover those as well.
+	 */
+	if (nw->conv_scaled && nw_spifb_scaler_pairs(&nw->scaler)) {
+		rect.x1 &= ~1;
+		rect.x2 = (rect.x2 + 1) & ~1;
+	}
+
+	/*
+	 * The overlay is opaque, so the primary is only converted around
+	 * it. Pieces widened to even columns may reach into it,
+	 * but the overlay is drawn afterwards.
+	 */
+	if (nw_spifb_overlay_rect(nw, &overlay) &&
+	    drm_rect_intersect(&overlay, &rect)) {
+		nw_spifb_convert_around(nw, &rect, &overlay);
+		nw_spifb_draw_overlay(&nw->scaler, &nw->overlay, tx,
+				      overlay.x1, overlay.y1,
+				      overlay.x2, overlay.y2);
+	} else {
+		nw_spifb_convert_rect(nw, &rect);
+	}
+
+	/* The cursor goes on top of what was just converted */
+	if (nw_spifb_cursor_rect(nw, &cursor)) {
+		nw_spifb_output_rect(nw, &cursor, &cursor);
+		if (drm_rect_intersect(&cursor, &rect))
+			nw_spifb_blend_cursor(&nw->scaler, &nw->cursor, tx,
+					      cursor.x1, cursor.y1,
+					      cursor.x2, cursor.y2);
+	}
+
+	/* Colour management applies to the blended result, as on a CRTC */
+	if (nw->colour_active && nw->conv_format != DRM_FORMAT_C8)
+		nw_spifb_colour_rect(&nw->scaler, nw->colour_table, tx,
+				     rect.x1, rect.y1, rect.x2, rect.y2);
+}
+
+/* Both TX buffers must be reconverted in full before they are used */
+static void nw_spifb_invalidate_tx(struct nw_spifb *nw)
+{
+	nw->tx_stale[0] = DRM_RECT_INIT(0, 0, nw->width, nw->height);
+	nw->tx_stale[1] = nw->tx_stale[0];
+}
+
+/*
+ * Mark the output that source @damage reaches as stale in both TX
+ * buffers: the write buffer converts it now, the other one the next
+ * time it is written.
+ */
+static void nw_spifb_mark_stale(struct nw_spifb *nw,
+				const struct drm_rect *damage)
+{
+	struct drm_rect out;
+
+	if (!drm_rect_visible(damage))
+		return;
+
+	nw_spifb_output_rect(nw, damage, &out);
+	nw_spifb_rect_union(&nw->tx_stale[0], &out);
+	nw_spifb_rect_union(&nw->tx_stale[1], &out);
+}
+
+/*
+ * Prepare a frame: scale/convert the compositor framebuffer into the
+ * current write-side TX buffer. CPU work only, no SPI. Only the first
+ * @rows output rows are converted; a streamed frame converts the rest
+ * with nw_spifb_convert_stale() as it goes. Returns false if the format
+ * cannot be converted.
+ *
+ * @damage is the merged damage in framebuffer coordinates. It limits
+ * what gets staged, and what gets converted: the output it reaches,
+ * plus whatever earlier frames converted into the other TX buffer only.
+ */
+static bool nw_spifb_prepare_frame(struct nw_spifb *nw,
+				    const struct iosys_map *src,
+				    const struct drm_framebuffer *fb,
+				    const struct drm_rect *damage, u32 rows)
+{
+	u32 format = fb->format->format;
+	struct nw_spifb_src sp = {
+		.base = src->vaddr,
+		.pitch = fb->pitches[0],
+	};
+	struct drm_rect cursor;
+
+	switch (format) {
+	case DRM_FORMAT_XRGB8888:
+	case DRM_FORMAT_ARGB8888:
+		format = DRM_FORMAT_XRGB8888;
+		sp.format = NW_SPIFB_SRC_XRGB8888;
+		break;
+	case DRM_FORMAT_RGB565:
+		sp.format = NW_SPIFB_SRC_RGB565;
+		break;
+	case DRM_FORMAT_C8:
+		sp.format = NW_SPIFB_SRC_C8;
+		sp.palette = &nw->c8_palette;
+		break;
+	case DRM_FORMAT_RGB332:
+		sp.format = NW_SPIFB_SRC_C8;
+		sp.palette = &nw->rgb332_palette;
+		break;
+	case DRM_FORMAT_R8:
+		sp.format = NW_SPIFB_SRC_C8;
+		sp.palette = &nw->grey_palette;
+		break;
+	default:
+		return false;
+	}
+
+	/* Every output pixel may change colour */
+	if (format != nw->conv_format || sp.palette != nw->conv_src.palette)
+		nw_spifb_invalidate_tx(nw);
+	nw_spifb_mark_stale(nw, damage);
+
+	/*
+	 * The cursor is blended after conversion, so the pixels under it
+	 * are reconverted every frame rather than blended twice.
+	 */
+	if (nw_spifb_cursor_rect(nw, &cursor))
+		nw_spifb_mark_stale(nw, &cursor);
+
+	/*
+	 * The DRM format helpers have no palette lookup, so 8-bit formats
+	 * go through the scaler even at 1:1, where its tables are the
+	 * identity.
+	 */
+	if (nw->vwidth != nw->width || nw->vheight != nw->height ||
+	    sp.format == NW_SPIFB_SRC_C8) {
+		/*
+		 * An imported buffer is mapped however its exporter maps
+		 * it: uncached for a vc4 render target, so it is always
+		 * staged.
+		 */
+		if (staging || fb->obj[0]->import_attach) {
+			struct drm_rect rect = *damage;
+			struct drm_rect full = DRM_RECT_INIT(0, 0, nw->vwidth,
+							     nw->vheight);
+
+			/* Nothing usable staged yet: copy the whole frame */
+			if (nw->staging_format != format)
+				rect = full;
+			if (drm_rect_intersect(&rect, &full))
+				nw_spifb_stage_rect(nw, src, fb, &rect);
+			nw->staging_format = format;
+			sp.base = nw->staging;
+			sp.pitch = nw->staging_pitch;
+		} else {
+			/* Staged rows go stale while bypassed */
+			nw->staging_format = 0;
+		}
+
+		/*
+		 * A filter change alters output outside the damage too, so
+		 * the hashes no longer describe what the LCD shows.
+		 */
+		if (nw->scaler.filter != filter) {
+			nw->scaler.filter = filter;
+			nw->band_hash_valid = false;
+			nw_spifb_invalidate_tx(nw);
+		}
+
+		/* Scaled mode: down- or upscale + format convert */
+		nw->conv_scaled = true;
+	} else {
+		/* 1:1 mode: use DRM format helpers */
+		nw->conv_scaled = false;
+		nw->conv_map = src;
+		nw->conv_fb = fb;
+	}
+
+	nw->conv_src = sp;
+	nw->conv_format = format;
+	nw_spifb_convert_stale(nw, 0, rows);
+
+	return true;
+}
+
+/*
+ * Load the C8 palette from a gamma LUT blob. Without one, C8 shows as
+ * greyscale; a short LUT only replaces its first entries.
+ */
+static void nw_spifb_load_palette(struct nw_spifb *nw,
+				  const struct drm_property_blob *lut)
+{
+	const struct drm_color_lut *c;
+	u32 i, n;
+
+	if (!lut) {
+		nw_spifb_palette_grey(&nw->c8_palette);
+		return;
+	}
+
+	c = lut->data;
+	n = min_t(u32, drm_color_lut_size(lut), NW_SPIFB_PALETTE_LEN);
+	for (i = 0; i < n; i++)
+		nw_spifb_palette_set(&nw->c8_palette, i,
+				     drm_color_lut_extract(c[i].red, 8),
+				     drm_color_lut_extract(c[i].green, 8),
+				     drm_color_lut_extract(c[i].blue, 8));
+}
+
+/*
+ * Per-channel LUTs from a LUT blob, resampled should it not have
+ * NW_SPIFB_COLOUR_LUT_LEN entries. Left alone without one.
+ */
+static void nw_spifb_colour_lut(u16 lut[3][NW_SPIFB_COLOUR_LUT_LEN],
+				const struct drm_property_blob *blob)
+{
+	const struct drm_color_lut *c;
+	u32 i, n;
+
+	if (!blob || !drm_color_lut_size(blob))
+		return;
+
+	n = drm_color_lut_size(blob);
+	for (i = 0; i < NW_SPIFB_COLOUR_LUT_LEN; i++) {
+		c = (const struct drm_color_lut *)blob->data +
+		    i * (n - 1) / (NW_SPIFB_COLOUR_LUT_LEN - 1);
+		lut[0][i] = c->red;
+		lut[1][i] = c->green;
+		lut[2][i] = c->blue;
+	}
+}
+
+/*
+ * Load colour management from CRTC property blobs @blob, NULL where
+ * unset, which make the colour table every format but C8 goes
+ * through. The gamma LUT means what it means for the framebuffer it
+ * was set with (@c8): a C8 client's palette, which leaves gamma out of
+ * the table, or anyone else's gamma curve, which leaves the palette
+ * alone. So a palette never turns into a gamma curve for the next
+ * client, nor night light into a palette.
+ */
+static void nw_spifb_load_colour(struct nw_spifb *nw,
+				 struct drm_property_blob **blob, bool c8)
+{
+	struct nw_spifb_colour *c = &nw->colour;
+	const struct drm_property_blob *gamma = c8 ? NULL : blob[NW_SPIFB_GAMMA];
+	const struct drm_color_ctm *ctm;
+	int i;
+
+	if (c8)
+		nw_spifb_load_palette(nw, blob[NW_SPIFB_GAMMA]);
+
+	if (!blob[NW_SPIFB_DEGAMMA] && !blob[NW_SPIFB_CTM] && !gamma) {
+		nw->colour_active = false;
+		return;
+	}
+
+	nw_spifb_colour_identity(c);
+	nw_spifb_colour_lut(c->degamma, blob[NW_SPIFB_DEGAMMA]);
+	nw_spifb_colour_lut(c->gamma, gamma);
+	if (blob[NW_SPIFB_CTM]) {
+		ctm = blob[NW_SPIFB_CTM]->data;
+		for (i = 0; i < ARRAY_SIZE(c->ctm); i++)
+			c->ctm[i] = drm_color_ctm_s31_32_to_qm_n(ctm->matrix[i],
+								 16, 16);
+	}
+
+	/* A few ms of table building, only when the properties change */
+	nw->colour_active = nw_spifb_colour_table(nw->colour_table, c);
+}
+
+static void nw_spifb_put_colour(struct drm_property_blob **blob)
+{
+	int i;
+
+	for (i = 0; i < NW_SPIFB_COLOUR_PROPS; i++)
+		drm_property_blob_put(blob[i]);
+}
+
+/*
+ * Switch to cursor @cur, first copying its image out of @fb if given
+ * (which is then released). The copy is what gets blended, so the
+ * uncached framebuffer is only read when the image changes.
+ */
+static void nw_spifb_load_cursor(struct nw_spifb *nw,
+				 const struct nw_spifb_cursor *cur,
+				 struct drm_framebuffer *fb)
+{
+	struct iosys_map map[DRM_FORMAT_MAX_PLANES];
+	struct iosys_map data[DRM_FORMAT_MAX_PLANES];
+	u32 y;
+
+	nw->cursor = *cur;
+	if (!fb)
+		return;
+
+	if (!drm_gem_fb_vmap(fb, map, data)) {
+		if (!drm_gem_fb_begin_cpu_access(fb, DMA_FROM_DEVICE)) {
+			for (y = 0; y < cur->height; y++)
+				memcpy(nw->cursor_argb + y * cur->width,
+				       (const u8 *)data[0].vaddr + y * fb->pitches[0],
+				       cur->width * 4);
+			drm_gem_fb_end_cpu_access(fb, DMA_FROM_DEVICE);
+		}
+		drm_gem_fb_vunmap(fb, map);
+	}
+	drm_framebuffer_put(fb);
+}
+
+/*
+ * Switch to overlay @ov showing @fb, or hide it if @fb is NULL, taking
+ * over the caller's reference and releasing the framebuffer shown so
+ * far. Where the overlay was and where it is now have to be converted
+ * again, but need no staging: that is left to the next frame.
+ */
+static void nw_spifb_load_overlay(struct nw_spifb *nw,
+				  const struct nw_spifb_overlay *ov,
+				  struct drm_framebuffer *fb)
+{
+	struct drm_rect rect;
+
+	if (nw->overlay_fb) {
+		rect = DRM_RECT_INIT(nw->overlay.x, nw->overlay.y,
+				     nw->overlay.width, nw->overlay.height);
+		nw_spifb_rect_union(&nw->overlay_damage, &rect);
+		drm_framebuffer_put(nw->overlay_fb);
+	}
+
+	nw->overlay = *ov;
+	nw->overlay_fb = fb;
+
+	if (fb) {
+		rect = DRM_RECT_INIT(ov->x, ov->y, ov->width, ov->height);
+		nw_spifb_rect_union(&nw->overlay_damage, &rect);
+	}
+}
+
+/*
+ * Map the overlay's framebuffer for the frame about to be converted.
+ * Returns false if it is hidden or cannot be read, and it is then left
+ * out of the frame.
+ */
+static bool nw_spifb_map_overlay(struct nw_spifb *nw, struct iosys_map *map)
+{
+	struct iosys_map data[DRM_FORMAT_MAX_PLANES];
+	struct drm_framebuffer *fb = nw->overlay_fb;
+	int i;
+
+	if (!fb || drm_gem_fb_vmap(fb, map, data))
+		return false;
+	if (drm_gem_fb_begin_cpu_access(fb, DMA_FROM_DEVICE)) {
+		drm_gem_fb_vunmap(fb, map);
+		return false;
+	}
+
+	for (i = 0; i < fb->format->num_planes; i++)
+		nw->overlay.plane[i] = data[i].vaddr;
+
+	return true;
+}
+
+static void nw_spifb_unmap_overlay(struct nw_spifb *nw, struct iosys_map *map)
+{
+	drm_gem_fb_end_cpu_access(nw->overlay_fb, DMA_FROM_DEVICE);
+	drm_gem_fb_vunmap(nw->overlay_fb, map);
+	memset(nw->overlay.plane, 0, sizeof(nw->overlay.plane));
+}
+
+/*
+ * Hash the converted frame band by band against the last frame sent
+ * and remember the new hashes. Returns a mask of the bands that differ;
+ * zero means the LCD already shows exactly these pixels and the frame
+ * need not be sent.
+ *
+ * Only bands meeting @conv, the output just converted, are hashed.
+ * The rest of the buffer has seen no damage since the last frame sent
+ * and matches it, unless the hashes are not valid yet, in which case
+ * everything was stale and converted anyway.
+ */
+static u32 nw_spifb_hash_bands(struct nw_spifb *nw, const u16 *tx,
+			       const struct drm_rect *conv)
+{
+	u32 band_rows = DIV_ROUND_UP(nw->height, HASH_BANDS);
+	u32 changed = 0;
+	u32 i, y;
+
+	for (i = 0, y = 0; y < nw->height; i++, y += band_rows) {
+		u32 rows = min(band_rows, nw->height - y);
+		u64 hash;
+
+		if (nw->band_hash_valid &&
+		    (y + rows <= conv->y1 || y >= conv->y2))
+			continue;
+
+		hash = xxh64(tx + y * nw->width, rows * nw->width * 2, 0);
+
+		if (!nw->band_hash_valid || hash != nw->band_hash[i]) {
+			nw->band_hash[i] = hash;
+			changed |= BIT(i);
+		}
+	}
+
+	nw->band_hash_valid = true;
+
+	return changed;
+}
+
+/*
+ * LCD window for a v2 update: the damage mapped through the scaler,
+ * trimmed to the rows of the bands whose hash changed. If the two do
+ * not overlap the output changed outside the damage, and only a full
+ * frame is safe.
+ */
+static void nw_spifb_damage_window(struct nw_spifb *nw,
+				   const struct drm_rect *damage, u32 changed,
+				   struct drm_rect *win)
+{
+	u32 band_rows = DIV_ROUND_UP(nw->height, HASH_BANDS);
+	struct drm_rect bands = DRM_RECT_INIT(0, (ffs(changed) - 1) * band_rows,
+					      nw->width, 0);
+	u32 x1, y1, x2, y2;
+
+	bands.y2 = min(nw->height, fls(changed) * band_rows);
+
+	nw_spifb_scaler_span(damage->x1, damage->x2, nw->vwidth, nw->width,
+			     &x1, &x2);
+	nw_spifb_scaler_span(damage->y1, damage->y2, nw->vheight, nw->height,
+			     &y1, &y2);
+	*win = DRM_RECT_INIT(x1, y1, x2 - x1, y2 - y1);
+
+	if (!drm_rect_intersect(win, &bands))
+		*win = DRM_RECT_INIT(0, 0, nw->width, nw->height);
+}
+
+/* Record how long a phase took from @start to @end; returns that in ns */
+static u64 nw_spifb_phase_time(struct nw_spifb *nw, enum nw_spifb_phase phase,
+			       ktime_t start, ktime_t end)
+{
+	u64 ns = ktime_to_ns(ktime_sub(end, start));
+	unsigned long flags;
+
+	spin_lock_irqsave(&nw->stats_lock, flags);
+	nw_spifb_hist_add(&nw->hist[phase], ns);
+	spin_unlock_irqrestore(&nw->stats_lock, flags);
+
+	return ns;
+}
+
+/* SPI async completion callback — runs in interrupt context */
+static void nw_spifb_spi_complete(void *context)
+{
+	struct nw_spifb *nw = context;
+	ktime_t now = ktime_get();
+	u64 ns;
+
+	/* The tx_* fields belong to the next frame once complete() runs */
+	ns = nw_spifb_phase_time(nw, NW_SPIFB_PHASE_SPI, nw->tx_start, now);
+	nw_spifb_phase_time(nw, NW_SPIFB_PHASE_LATENCY, nw->tx_commit, now);
+	trace_drm_spifb_spi_complete(nw->tx_seq, nw->tx_last->status, ns);
+
+	/*
+	 * A field's missing rows go next, unless a frame takes them along
+	 * or the pipe is going down (the worker must stay cancelled)
+	 */
+	if (READ_ONCE(nw->field_followup) && !READ_ONCE(nw->field_stop))
+		queue_work(system_highpri_wq, &nw->work);
+
+	complete(&nw->tx_done);
+
+	/*
+	 * The frame is on the LCD: that is this display's vblank. Restart
+	 * the fallback timer so it only ticks if no transfer follows.
+	 */
+	if (READ_ONCE(nw->vblank_on)) {
+		drm_crtc_handle_vblank(&nw->pipe.crtc);
+		hrtimer_start(&nw->vblank_timer, ns_to_ktime(nw->frame_ns),
+			      HRTIMER_MODE_REL);
+	}
+}
+
+/*
+ * Fallback vblank while the bus is idle, e.g. when frames are skipped
+ * as unchanged. A transfer in flight signals its own on completion.
+ */
+static enum hrtimer_restart nw_spifb_vblank_timer(struct hrtimer *timer)
+{
+	struct nw_spifb *nw = container_of(timer, struct nw_spifb, vblank_timer);
+
+	if (!READ_ONCE(nw->vblank_on))
+		return HRTIMER_NORESTART;
+
+	if (completion_done(&nw->tx_done))
+		drm_crtc_handle_vblank(&nw->pipe.crtc);
+
+	hrtimer_forward_now(timer, ns_to_ktime(nw->frame_ns));
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Wait for the transfer in flight, if any, to finish. Afterwards the
+ * framebuffer a zero-copy send was reading can be let go.
+ */
+static void nw_spifb_wait_tx(struct nw_spifb *nw)
+{
+	ktime_t start = ktime_get();
+	u64 ns;
+
+	trace_drm_spifb_wait_begin(nw->frame_seq);
+	wait_for_completion(&nw->tx_done);
+	reinit_completion(&nw->tx_done);
+	ns = nw_spifb_phase_time(nw, NW_SPIFB_PHASE_WAIT, start, ktime_get());
+	trace_drm_spifb_wait_end(nw->frame_seq, ns);
+
+	if (nw->tx_fb) {
+		drm_framebuffer_put(nw->tx_fb);
+		nw->tx_fb = NULL;
+	}
+}
+
+/*
+ * Start one SPI message after nw_spifb_wait_tx(): @hdr_len bytes of @hdr
+ * in their own transfer if @hdr is given, then @len bytes of @buf, all
+ * in one CS assertion. @win and @encoding are for the trace only.
+ */
+static void nw_spifb_start_tx(struct nw_spifb *nw, const void *hdr,
+			      size_t hdr_len, const void *buf, size_t len,
+			      const struct drm_rect *win, u32 encoding,
+			      ktime_t committed)
+{
+	struct spi_transfer *xfer = nw->tx_xfers;
+
+	spi_message_init(&nw->tx_msg);
+	memset(nw->tx_xfers, 0, sizeof(nw->tx_xfers));
+
+	if (hdr) {
+		xfer->tx_buf = hdr;
+		xfer->len = hdr_len;
+		spi_message_add_tail(xfer++, &nw->tx_msg);
+	}
+
+	xfer->tx_buf = buf;
+	xfer->len = len;
+	spi_message_add_tail(xfer, &nw->tx_msg);
+
+	nw->tx_msg.complete = nw_spifb_spi_complete;
+	nw->tx_msg.context = nw;
+	nw->tx_last = &nw->tx_msg;
+
+	trace_drm_spifb_submit(nw->frame_seq, win, encoding, hdr_len + len);
+	nw->tx_seq = nw->frame_seq;
+	nw->tx_commit = committed;
+	nw->tx_start = ktime_get();
+	spi_async(nw->spi, &nw->tx_msg);
+	nw->frames_sent++;
+	atomic64_add(hdr_len + len, &nw->bytes_sent);
+}
+
+/*
+ * Flip TX buffers after a send: the buffer just sent becomes the one
+ * debugfs 'converted' copies, the other is written next. A capture holds
+ * capture_lock while copying, so the worker never writes into it.
+ */
+static void nw_spifb_flip(struct nw_spifb *nw)
+{
+	mutex_lock(&nw->capture_lock);
+	nw->tx_write ^= 1;
+	nw->sent_seq = nw->frame_seq;
+	mutex_unlock(&nw->capture_lock);
+}
+
+/*
+ * Encode window (@x, @y, @w, @h) of TX buffer contents @frame as a v2
+ * message into @out, every other row if @field: as RGB332 on an 8-bit
+ * wire, otherwise in the encoding 'compress' asks for. @prev is what
+ * the LCD shows, for XOR delta, or NULL.
+ */
+static size_t nw_spifb_encode(struct nw_spifb *nw, void *out,
+			      const u16 *frame, const u16 *prev, u32 x, u32 y,
+			      u32 w, u32 h, bool field)
+{
+	struct nw_spifb_wire_hdr *hdr = out;
+	size_t len;
+
+	if (nw->rgb332)
+		len = nw_spifb_wire_encode_rgb332(out, frame, nw->width, x, y,
+						  w, h, field,
+						  READ_ONCE(dither));
+	else
+		len = nw_spifb_wire_encode(out, frame, prev, nw->width, x, y,
+					   w, h, min_t(uint, compress,
+						       NW_SPIFB_ENC_XOR_RLE),
+					   field);
+	nw->enc_frames[hdr->encoding & ~NW_SPIFB_WIRE_FIELD]++;
+
+	return len;
+}
+
+/*
+ * Submit the current write buffer via async SPI, then flip to the
+ * other buffer for the next prepare. Waits for any in-flight transfer
+ * to complete first. @win is the LCD window to update; v1 always sends
+ * the whole frame. @known says the LCD shows the last frame sent, which
+ * XOR delta encoding relies on. @committed is when the frame's commit
+ * queued it.
+ */
+static void nw_spifb_submit_frame(struct nw_spifb *nw,
+				  const struct drm_rect *win, bool known,
+				  ktime_t committed)
+{
+	size_t frame_size = nw->width * nw->height * 2; /* RGB565 output */
+	void *buf = nw->tx_buf[nw->tx_write];
+	u32 encoding = NW_SPIFB_ENC_RAW;
+	ktime_t start;
+
+	/*
+	 * Encoding only touches this side's buffers, so no need to wait.
+	 * The other TX buffer still holds the last frame sent: skipped
+	 * frames do not flip.
+	 */
+	if (nw->partial) {
+		struct nw_spifb_wire_hdr *hdr = nw->wire_buf[nw->tx_write];
+
+		start = ktime_get();
+		buf = hdr;
+		frame_size = nw_spifb_encode(nw, hdr, nw->tx_buf[nw->tx_write],
+					     known ? nw->tx_buf[!nw->tx_write] : NULL,
+					     win->x1, win->y1,
+					     drm_rect_width(win),
+					     drm_rect_height(win), false);
+		encoding = hdr->encoding;
+		nw_spifb_phase_time(nw, NW_SPIFB_PHASE_ENCODE, start, ktime_get());
+	}
+
+	/* Wait for previous async transfer to finish */
+	nw_spifb_wait_tx(nw);
+
+	/* Only ever a full frame while the LCD is owed rows of a field */
+	nw->field_owed = DRM_RECT_INIT(0, 0, 0, 0);
+	WRITE_ONCE(nw->field_followup, false);
+
+	/* Single SPI transfer per message — no chunking overhead */
+	nw_spifb_start_tx(nw, NULL, 0, buf, frame_size, win, encoding,
+			  committed);
+
+	/* Flip to the other buffer for next frame's CPU work */
+	nw_spifb_flip(nw);
+}
+
+/*
+ * Send the next field (see 'field' param): the rows of parity
+ * field_parity across @win, the new damage, and the window the LCD is
+ * owed rows of. The new damage's other rows are owed next. With field
+ * mode off, or a single row of the other parity, the lot goes out whole
+ * instead. No XOR delta: the LCD is behind the buffer it would be taken
+ * against. A @followup has no new frame and sends from the last one,
+ * whose wire buffer the transfer in flight is still reading, so it
+ * encodes only after the wait and does not flip.
+ */
+static void nw_spifb_submit_field(struct nw_spifb *nw,
+				  const struct drm_rect *win, bool followup,
+				  ktime_t committed)
+{
+	int buf = followup ? !nw->tx_write : nw->tx_write;
+	struct nw_spifb_wire_hdr *hdr = nw->wire_buf[buf];
+	struct drm_rect rows = nw->field_owed;
+	bool interlace;
+	size_t len;
+	u32 first, y, h;
+	ktime_t start;
+
+	nw_spifb_rect_union(&rows, win);
+	first = rows.y1 + ((rows.y1 ^ nw->field_parity) & 1);
+	interlace = READ_ONCE(field) && first < rows.y2;
+
+	if (followup)
+		nw_spifb_wait_tx(nw);
+
+	y = interlace ? first : rows.y1;
+	h = interlace ? (rows.y2 - first + 1) / 2 : drm_rect_height(&rows);
+
+	start = ktime_get();
+	len = nw_spifb_encode(nw, hdr, nw->tx_buf[buf], NULL, rows.x1, y,
+			      drm_rect_width(&rows), h, interlace);
+	nw_spifb_phase_time(nw, NW_SPIFB_PHASE_ENCODE, start, ktime_get());
+
+	if (interlace) {
+		nw->field_owed = *win;
+		nw->field_parity ^= 1;
+		nw->fields_sent++;
+	} else {
+		nw->field_owed = DRM_RECT_INIT(0, 0, 0, 0);
+	}
+
+	if (!followup)
+		nw_spifb_wait_tx(nw);
+
+	WRITE_ONCE(nw->field_followup, drm_rect_visible(&nw->field_owed));
+	nw_spifb_start_tx(nw, NULL, 0, hdr, len, &rows,
+			  hdr->encoding & ~NW_SPIFB_WIRE_FIELD, committed);
+
+	if (!followup)
+		nw_spifb_flip(nw);
+}
+
+/*
+ * Worker run without a frame, queued by the completion of a field: send
+ * the rows it left out, from the last frame sent.
+ */
+static void nw_spifb_field_followup(struct nw_spifb *nw)
+{
+	struct drm_rect none = DRM_RECT_INIT(0, 0, 0, 0);
+	int idx;
+
+	if (READ_ONCE(nw->field_stop) || !drm_rect_visible(&nw->field_owed))
+		return;
+	if (!drm_dev_enter(&nw->drm, &idx))
+		return;
+
+	nw_spifb_submit_field(nw, &none, true, ktime_get());
+	drm_dev_exit(idx);
+}
+
+/*
+ * Send a v1 frame in @chunks chunks of rows, the first of which
+ * nw_spifb_prepare_frame() has converted. Each chunk is queued as its
+ * own message as soon as it is converted and goes out while the next
+ * one is converted. Every message but the last ends with cs_change,
+ * which keeps CS asserted until the next one, so the STM32 still sees
+ * one frame. Only the last message signals completion. Flips like
+ * nw_spifb_submit_frame().
+ */
+static void nw_spifb_stream_frame(struct nw_spifb *nw, u32 chunks,
+				  ktime_t committed)
+{
+	struct drm_rect win = DRM_RECT_INIT(0, 0, nw->width, nw->height);
+	u32 rows = DIV_ROUND_UP(nw->height, chunks);
+	u16 *tx = nw->tx_buf[nw->tx_write];
+	u32 i, y0, y1;
+
+	nw_spifb_wait_tx(nw);
+
+	trace_drm_spifb_submit(nw->frame_seq, &win, NW_SPIFB_ENC_RAW,
+			       nw->width * nw->height * 2);
+	nw->tx_seq = nw->frame_seq;
+	nw->tx_commit = committed;
+	nw->tx_start = ktime_get();
+
+	for (i = 0, y0 = 0; y0 < nw->height; i++, y0 = y1) {
+		struct spi_message *msg = &nw->stream_msg[i];
+		struct spi_transfer *xfer = &nw->stream_xfer[i];
+		bool last;
+
+		y1 = min(y0 + rows, nw->height);
+		last = y1 == nw->height;
+
+		spi_message_init(msg);
+		memset(xfer, 0, sizeof(*xfer));
+		xfer->tx_buf = tx + y0 * nw->width;
+		xfer->len = (y1 - y0) * nw->width * 2;
+		xfer->cs_change = !last;
+		spi_message_add_tail(xfer, msg);
+
+		if (last) {
+			msg->complete = nw_spifb_spi_complete;
+			msg->context = nw;
+			nw->tx_last = msg;
+		}
+
+		spi_async(nw->spi, msg);
+
+		if (!last)
+			nw_spifb_convert_stale(nw, y1, min(y1 + rows, nw->height));
+	}
+
+	nw->frames_sent++;
+	atomic64_add(nw->width * nw->height * 2, &nw->bytes_sent);
+	nw_spifb_flip(nw);
+}
+
+/*
+ * Where the SPI DMA can read @fb directly, or NULL if it has to be
+ * converted: zero-copy needs a 1:1 mode and a native RGB565 GEM DMA
+ * buffer at LCD size whose rows are contiguous, so that any run of whole
+ * rows is one span.
+ */
+static const u8 *nw_spifb_zero_copy_src(struct nw_spifb *nw,
+					struct drm_framebuffer *fb)
+{
+	struct drm_gem_dma_object *dma;
+
+	if (!zerocopy || !nw->partial || nw->cursor.argb || nw->overlay_fb ||
+	    nw->colour_active || nw->rgb332 || READ_ONCE(field) ||
+	    drm_rect_visible(&nw->field_owed) ||
+	    fb->format->format != DRM_FORMAT_RGB565 ||
+	    !nw_spifb_scaler_passthrough(&nw->scaler, fb->width, fb->height,
+					 fb->pitches[0]))
+		return NULL;
+
+	dma = drm_fb_dma_get_gem_obj(fb, 0);
+	if (!dma || !dma->vaddr || dma->base.import_attach)
+		return NULL;
+
+	return (const u8 *)dma->vaddr + fb->offsets[0];
+}
+
+/*
+ * Send the rows @damage touches straight from @src in @fb, which stays
+ * referenced until the transfer is done. The TX buffers are bypassed,
+ * so afterwards nothing is known about what the LCD shows.
+ */
+static void nw_spifb_send_zero_copy(struct nw_spifb *nw,
+				    struct drm_framebuffer *fb, const u8 *src,
+				    const struct drm_rect *damage,
+				    ktime_t committed)
+{
+	struct drm_rect win = DRM_RECT_INIT(0, damage->y1, nw->width,
+					    drm_rect_height(damage));
+	size_t len = drm_rect_height(&win) * fb->pitches[0];
+
+	nw_spifb_wait_tx(nw);
+
+	/* Written only now: the previous send may have been reading it */
+	nw_spifb_wire_hdr_init(nw->zc_hdr, NW_SPIFB_ENC_RAW_LE, win.x1,
+			       win.y1, drm_rect_width(&win),
+			       drm_rect_height(&win), len);
+	nw->enc_frames[NW_SPIFB_ENC_RAW_LE]++;
+	nw->band_hash_valid = false;
+	nw_spifb_invalidate_tx(nw);
+	nw->tx_fb = fb;
+
+	/* The LCD no longer shows what the TX buffers hold */
+	mutex_lock(&nw->capture_lock);
+	nw->sent_seq = 0;
+	mutex_unlock(&nw->capture_lock);
+
+	nw_spifb_start_tx(nw, nw->zc_hdr, sizeof(*nw->zc_hdr),
+			  src + win.y1 * fb->pitches[0], len, &win,
+			  NW_SPIFB_ENC_RAW_LE, committed);
+}
+
+/*
+ * Wait for the transfer in flight, if any (1s timeout to avoid hanging
+ * shutdown), and leave tx_done signalled again: nothing is in flight,
+ * and the next frame must not wait on it.
+ */
+static void nw_spifb_drain(struct nw_spifb *nw)
+{
+	if (!wait_for_completion_timeout(&nw->tx_done, HZ)) {
+		/* The DMA may still read tx_fb, so it stays referenced */
+		dev_warn(&nw->spi->dev, "SPI transfer timeout\n");
+		return;
+	}
+
+	if (nw->tx_fb) {
+		drm_framebuffer_put(nw->tx_fb);
+		nw->tx_fb = NULL;
+	}
+	complete(&nw->tx_done);
+}
+
+/* --- DRM simple display pipe callbacks --- */
+
+static enum drm_mode_status
+nw_spifb_pipe_mode_valid(struct drm_simple_display_pipe *pipe,
+			 const struct drm_display_mode *mode)
+{
+	struct nw_spifb *nw = drm_to_nw(pipe->crtc.dev);
+	u32 i;
+
+	for (i = 0; i < nw->num_vmodes; i++)
+		if (mode->hdisplay == nw->vmodes[i].width &&
+		    mode->vdisplay == nw->vmodes[i].height)
+			return MODE_OK;
+
+	return MODE_BAD;
+}
+
+/*
+ * Framebuffers may be larger than the mode, up to the largest mode on
+ * offer, but the worker always reads from their origin: no panning.
+ */
+static int nw_spifb_pipe_check(struct drm_simple_display_pipe *pipe,
+			       struct drm_plane_state *plane_state,
+			       struct drm_crtc_state *crtc_state)
+{
+	if (plane_state->fb && (plane_state->src.x1 || plane_state->src.y1))
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * Switch to the virtual resolution of @mode. Only called on enable,
+ * with the worker stopped and the bus drained, so nothing is using the
+ * scaler or the staging buffer. The frame queued next is a full one,
+ * which restages and reconverts everything at the new size.
+ */
+static void nw_spifb_set_vmode(struct nw_spifb *nw,
+			       const struct drm_display_mode *mode)
+{
+	if (mode->hdisplay == nw->vwidth && mode->vdisplay == nw->vheight)
+		return;
+
+	nw->vwidth = mode->hdisplay;
+	nw->vheight = mode->vdisplay;
+	nw_spifb_scaler_init(&nw->scaler, nw->scaler_tables, nw->width,
+			     nw->height, nw->vwidth, nw->vheight);
+	nw->staging_pitch = nw->vwidth * 4;
+	nw_spifb_invalidate_tx(nw);
+}
+
+/*
+ * Worker: convert the newest queued frame and send it. Runs on its own,
+ * so it may wait for the previous transfer without holding up commits.
+ *
+ * The framebuffer is read after its commit has returned. Should the
+ * compositor already be drawing into it again, the newer commit is
+ * queued by then and the next run sends the finished image.
+ */
+static void nw_spifb_work(struct work_struct *work)
+{
+	struct nw_spifb *nw = container_of(work, struct nw_spifb, work);
+	struct iosys_map map[DRM_FORMAT_MAX_PLANES];
+	struct iosys_map data[DRM_FORMAT_MAX_PLANES];
+	struct iosys_map ov_map[DRM_FORMAT_MAX_PLANES];
+	struct drm_rect win = DRM_RECT_INIT(0, 0, nw->width, nw->height);
+	struct drm_framebuffer *fb, *cursor_fb, *overlay_fb;
+	struct drm_property_blob *colour[NW_SPIFB_COLOUR_PROPS];
+	struct drm_rect damage, conv, cursor, ov_damage;
+	struct nw_spifb_cursor cur;
+	struct nw_spifb_overlay ov;
+	const u8 *direct;
+	ktime_t committed, start;
+	bool full, known, converted, colour_set, colour_c8, cursor_set, overlay_set;
+	bool ov_mapped;
+	u32 changed, chunks, rows;
+	u64 ns;
+	int idx, buf;
+
+	spin_lock(&nw->pending_lock);
+	fb = nw->pending_fb;
+	damage = nw->pending_damage;
+	full = nw->pending_full;
+	committed = nw->pending_time;
+	memcpy(colour, nw->pending_colour, sizeof(colour));
+	colour_set = nw->pending_colour_set;
+	colour_c8 = nw->pending_colour_c8;
+	cur = nw->pending_cursor;
+	cursor_fb = nw->pending_cursor_fb;
+	cursor_set = nw->pending_cursor_set;
+	ov = nw->pending_overlay;
+	overlay_fb = nw->pending_overlay_fb;
+	overlay_set = nw->pending_overlay_set;
+	nw->pending_fb = NULL;
+	nw->pending_full = false;
+	memset(nw->pending_colour, 0, sizeof(nw->pending_colour));
+	nw->pending_colour_set = false;
+	nw->pending_cursor_fb = NULL;
+	nw->pending_cursor_set = false;
+	nw->pending_overlay_fb = NULL;
+	nw->pending_overlay_set = false;
+	spin_unlock(&nw->pending_lock);
+
+	/* Colours only change between frames, never under a conversion */
+	if (colour_set) {
+		nw_spifb_load_colour(nw, colour, colour_c8);
+		nw_spifb_put_colour(colour);
+	}
+
+	/*
+	 * Same for the cursor. Where it was and where it is now are both
+	 * damage; should this run have no frame, the commit that moved
+	 * the cursor queues one with that damage right after.
+	 */
+	if (cursor_set) {
+		if (nw_spifb_cursor_rect(nw, &cursor))
+			nw_spifb_rect_union(&damage, &cursor);
+		nw_spifb_load_cursor(nw, &cur, cursor_fb);
+		if (nw_spifb_cursor_rect(nw, &cursor))
+			nw_spifb_rect_union(&damage, &cursor);
+	}
+
+	/*
+	 * The overlay keeps its damage until a frame converts it. Its
+	 * pixels come straight from its own framebuffer, so unlike the
+	 * cursor it never adds to what gets staged.
+	 */
+	if (overlay_set)
+		nw_spifb_load_overlay(nw, &ov, overlay_fb);
+
+	if (!fb) {
+		nw_spifb_field_followup(nw);
+		return;
+	}
+
+	start = ktime_get();
+	nw_spifb_phase_time(nw, NW_SPIFB_PHASE_QUEUE, committed, start);
+	nw->frame_seq++;
+
+	if (!drm_dev_enter(&nw->drm, &idx))
+		goto out_put;
+
+	/*
+	 * First frame after enable: stage everything, nothing is valid
+	 * yet. The LCD may have been drawn on by the calculator meanwhile,
+	 * so the band hashes are refreshed without being compared.
+	 */
+	if (full) {
+		damage = DRM_RECT_INIT(0, 0, nw->vwidth, nw->vheight);
+		nw->staging_format = 0;
+		nw->band_hash_valid = false;
+	}
+
+	/* Overlay changes go out with this frame, whatever else it holds */
+	ov_damage = nw->overlay_damage;
+	nw->overlay_damage = DRM_RECT_INIT(0, 0, 0, 0);
+	nw_spifb_mark_stale(nw, &ov_damage);
+
+	/* Native RGB565 at 1:1: no conversion at all (see 'zerocopy') */
+	direct = nw_spifb_zero_copy_src(nw, fb);
+	if (direct) {
+		/* An overlay just hidden still needs its rows sent */
+		nw_spifb_rect_union(&damage, &ov_damage);
+		nw_spifb_send_zero_copy(nw, fb, direct, &damage, committed);
+		fb = NULL;	/* Now owned by the transfer */
+		goto out_exit;
+	}
+
+	/*
+	 * A streamed v1 frame only has its first chunk converted up
+	 * front, the rest while earlier chunks are on the bus.
+	 */
+	chunks = nw->partial ? 1 : clamp(READ_ONCE(stream), 1U,
+					 MAX_STREAM_CHUNKS);
+	rows = DIV_ROUND_UP(nw->height, chunks);
+
+	trace_drm_spifb_prepare_begin(nw->frame_seq);
+
+	if (drm_gem_fb_vmap(fb, map, data))
+		goto out_exit;
+	if (drm_gem_fb_begin_cpu_access(fb, DMA_FROM_DEVICE)) {
+		drm_gem_fb_vunmap(fb, map);
+		goto out_exit;
+	}
+
+	ov_mapped = nw_spifb_map_overlay(nw, ov_map);
+
+	buf = nw->tx_write;
+	converted = nw_spifb_prepare_frame(nw, &data[0], fb, &damage, rows);
+	conv = nw->tx_stale[buf];
+	if (converted && chunks > 1)
+		nw_spifb_stream_frame(nw, chunks, committed);
+
+	if (ov_mapped)
+		nw_spifb_unmap_overlay(nw, ov_map);
+	drm_gem_fb_end_cpu_access(fb, DMA_FROM_DEVICE);
+	drm_gem_fb_vunmap(fb, map);
+
+	if (!converted)
+		goto out_exit;
+
+	/* The buffer now holds the whole frame */
+	nw->tx_stale[buf] = DRM_RECT_INIT(0, 0, 0, 0);
+
+	/*
+	 * Sent already: only bring the hashes up to date. Conversion
+	 * overlapped the wait and the bus, so it stays out of the prepare
+	 * histogram.
+	 */
+	if (chunks > 1) {
+		trace_drm_spifb_prepare_end(nw->frame_seq,
+					    ktime_to_ns(ktime_sub(ktime_get(), start)));
+		nw_spifb_hash_bands(nw, nw->tx_buf[buf], &conv);
+		goto out_exit;
+	}
+
+	ns = nw_spifb_phase_time(nw, NW_SPIFB_PHASE_PREPARE, start, ktime_get());
+	trace_drm_spifb_prepare_end(nw->frame_seq, ns);
+
+	/*
+	 * Frames that convert to the pixels already on the LCD are not
+	 * sent at all; the write buffer is then simply reused for the
+	 * next one.
+	 */
+	known = nw->band_hash_valid;
+	changed = nw_spifb_hash_bands(nw, nw->tx_buf[buf], &conv);
+	if (!changed && !drm_rect_visible(&nw->field_owed)) {
+		nw->frames_skipped++;
+		trace_drm_spifb_skip(nw->frame_seq);
+		goto out_exit;
+	}
+
+	/*
+	 * A v1 slave expects a complete 320x240 frame per CS assertion.
+	 * With v2 only the damaged window goes out, as long as the LCD is
+	 * known to hold the rest.
+	 */
+	if (nw->partial && known) {
+		nw_spifb_rect_union(&damage, &ov_damage);
+		if (changed)
+			nw_spifb_damage_window(nw, &damage, changed, &win);
+		else
+			win = DRM_RECT_INIT(0, 0, 0, 0);
+
+		if (READ_ONCE(field) || drm_rect_visible(&nw->field_owed)) {
+			nw_spifb_submit_field(nw, &win, false, committed);
+			goto out_exit;
+		}
+	}
+
+	nw_spifb_submit_frame(nw, &win, known, committed);
+
+out_exit:
+	drm_dev_exit(idx);
+out_put:
+	if (fb)
+		drm_framebuffer_put(fb);
+}
+
+/*
+ * Hand a frame to the worker. If the previous one has not been picked
+ * up yet it is dropped, and its damage carried over to this one.
+ * @damage may be empty, when only the overlay changed.
+ */
+static void nw_spifb_queue_frame(struct nw_spifb *nw,
+				 struct drm_framebuffer *fb,
+				 const struct drm_rect *damage, bool full)
+{
+	struct drm_rect *pending = &nw->pending_damage;
+	struct drm_framebuffer *old;
+
+	drm_framebuffer_get(fb);
+
+	spin_lock(&nw->pending_lock);
+	old = nw->pending_fb;
+	if (old) {
+		nw_spifb_rect_union(pending, damage);
+		nw->frames_dropped++;
+	} else {
+		*pending = *damage;
+	}
+	nw->pending_fb = fb;
+	nw->pending_full |= full;
+	nw->pending_time = ktime_get();
+	spin_unlock(&nw->pending_lock);
+
+	trace_drm_spifb_queue(damage, old);
+
+	if (old)
+		drm_framebuffer_put(old);
+
+	queue_work(system_highpri_wq, &nw->work);
+}
+
+/*
+ * Hand the worker the colour management of CRTC state @state, loaded
+ * before it converts the next frame.
+ */
+static void nw_spifb_queue_colour(struct nw_spifb *nw,
+				  const struct drm_crtc_state *state,
+				  const struct drm_framebuffer *fb)
+{
+	struct drm_property_blob *blob[NW_SPIFB_COLOUR_PROPS] = {
+		[NW_SPIFB_DEGAMMA]	= state->degamma_lut,
+		[NW_SPIFB_CTM]		= state->ctm,
+		[NW_SPIFB_GAMMA]	= state->gamma_lut,
+	};
+	struct drm_property_blob *old[NW_SPIFB_COLOUR_PROPS];
+	int i;
+
+	for (i = 0; i < NW_SPIFB_COLOUR_PROPS; i++)
+		if (blob[i])
+			drm_property_blob_get(blob[i]);
+
+	spin_lock(&nw->pending_lock);
+	memcpy(old, nw->pending_colour, sizeof(old));
+	memcpy(nw->pending_colour, blob, sizeof(blob));
+	nw->pending_colour_set = true;
+	nw->pending_colour_c8 = fb && fb->format->format == DRM_FORMAT_C8;
+	spin_unlock(&nw->pending_lock);
+
+	nw_spifb_put_colour(old);
+}
+
+/*
+ * Hand the worker the cursor of plane state @state, to blend from the
+ * next frame on. Its image is reloaded if it is new or was redrawn.
+ * Returns false if @old already showed the same, e.g. when the commit
+ * only pulled the cursor plane in alongside the primary; otherwise
+ * @moved is the source area where the cursor was or is now. Without
+ * @old, the cursor is always queued and its image reloaded.
+ */
+static bool nw_spifb_queue_cursor(struct nw_spifb *nw,
+				  const struct drm_plane_state *old,
+				  const struct drm_plane_state *state,
+				  struct drm_rect *moved)
+{
+	bool was = old && old->visible;
+	bool image = !old || !was || old->fb != state->fb ||
+		     old->src_w != state->src_w || old->src_h != state->src_h ||
+		     drm_plane_get_damage_clips_count(state);
+	struct nw_spifb_cursor cur = {
+		.width = state->src_w >> 16,
+		.height = state->src_h >> 16,
+		.x = state->crtc_x,
+		.y = state->crtc_y,
+	};
+	struct drm_framebuffer *fb = NULL, *prev;
+
+	if (old && !was && !state->visible)
+		return false;
+	if (old && was && state->visible && !image &&
+	    old->crtc_x == state->crtc_x && old->crtc_y == state->crtc_y)
+		return false;
+
+	*moved = DRM_RECT_INIT(0, 0, 0, 0);
+	if (was)
+		*moved = old->dst;
+	if (state->visible) {
+		nw_spifb_rect_union(moved, &state->dst);
+		cur.argb = nw->cursor_argb;
+		if (image) {
+			fb = state->fb;
+			drm_framebuffer_get(fb);
+		}
+	}
+
+	/* A queued image not picked up yet still needs loading */
+	spin_lock(&nw->pending_lock);
+	prev = nw->pending_cursor_fb;
+	if (fb || !cur.argb)
+		nw->pending_cursor_fb = fb;
+	else
+		prev = NULL;
+	nw->pending_cursor = cur;
+	nw->pending_cursor_set = true;
+	spin_unlock(&nw->pending_lock);
+
+	if (prev)
+		drm_framebuffer_put(prev);
+
+	return true;
+}
+
+static enum nw_spifb_yuv_matrix
+nw_spifb_yuv_matrix(const struct drm_plane_state *state)
+{
+	bool full = state->color_range == DRM_COLOR_YCBCR_FULL_RANGE;
+
+	if (state->color_encoding == DRM_COLOR_YCBCR_BT709)
+		return full ? NW_SPIFB_BT709_FULL : NW_SPIFB_BT709_LIMITED;
+
+	return full ? NW_SPIFB_BT601_FULL : NW_SPIFB_BT601_LIMITED;
+}
+
+/*
+ * Hand the worker the overlay of plane state @state, shown from the
+ * next frame on. Returns false if @old already showed the same. A
+ * framebuffer counts as the same one unless it was flipped to or came
+ * with damage clips, so clients drawing into the one they show must
+ * send clips. Without @old, the overlay is always queued.
+ */
+static bool nw_spifb_queue_overlay(struct nw_spifb *nw,
+				   const struct drm_plane_state *old,
+				   const struct drm_plane_state *state)
+{
+	struct nw_spifb_overlay ov = { };
+	struct drm_framebuffer *fb = NULL, *prev;
+	int i;
+
+	if (old && !old->visible && !state->visible)
+		return false;
+	if (old && old->visible && state->visible && old->fb == state->fb &&
+	    drm_rect_equals(&old->src, &state->src) &&
+	    drm_rect_equals(&old->dst, &state->dst) &&
+	    old->color_encoding == state->color_encoding &&
+	    old->color_range == state->color_range &&
+	    !drm_plane_get_damage_clips_count(state))
+		return false;
+
+	if (state->visible) {
+		fb = state->fb;
+		switch (fb->format->format) {
+		case DRM_FORMAT_NV12:
+			ov.format = NW_SPIFB_YUV_NV12;
+			break;
+		case DRM_FORMAT_YUV420:
+			ov.format = NW_SPIFB_YUV_I420;
+			break;
+		default:
+			ov.format = NW_SPIFB_YUV_GREY;
+			break;
+		}
+		ov.matrix = nw_spifb_yuv_matrix(state);
+		for (i = 0; i < fb->format->num_planes; i++)
+			ov.pitch[i] = fb->pitches[i];
+
+		/* Clipped to the frame by the plane check */
+		ov.src_x = state->src.x1 >> 16;
+		ov.src_y = state->src.y1 >> 16;
+		ov.src_w = drm_rect_width(&state->src) >> 16;
+		ov.src_h = drm_rect_height(&state->src) >> 16;
+		ov.x = state->dst.x1;
+		ov.y = state->dst.y1;
+		ov.width = drm_rect_width(&state->dst);
+		ov.height = drm_rect_height(&state->dst);
+		drm_framebuffer_get(fb);
+	}
+
+	spin_lock(&nw->pending_lock);
+	prev = nw->pending_overlay_fb;
+	nw->pending_overlay = ov;
+	nw->pending_overlay_fb = fb;
+	nw->pending_overlay_set = true;
+	spin_unlock(&nw->pending_lock);
+
+	if (prev)
+		drm_framebuffer_put(prev);
+
+	return true;
+}
+
+/*
+ * Stop the worker and drop whatever frame it has not picked up, and
+ * the overlay it shows. Queued colour management is loaded instead, so
+ * the next enable still uses it.
+ */
+static void nw_spifb_cancel_frames(struct nw_spifb *nw)
+{
+	struct drm_framebuffer *fb, *cursor_fb, *overlay_fb;
+	struct nw_spifb_overlay hidden = { };
+	struct drm_property_blob *colour[NW_SPIFB_COLOUR_PROPS];
+	bool colour_set, colour_c8;
+
+	/*
+	 * No completion requeues the worker from here on. One that read
+	 * field_stop just before this may still do it: callers cancel the
+	 * work again once nw_spifb_drain() has seen the transfer end.
+	 */
+	WRITE_ONCE(nw->field_stop, true);
+	WRITE_ONCE(nw->field_followup, false);
+	cancel_work_sync(&nw->work);
+
+	spin_lock(&nw->pending_lock);
+	fb = nw->pending_fb;
+	memcpy(colour, nw->pending_colour, sizeof(colour));
+	colour_set = nw->pending_colour_set;
+	colour_c8 = nw->pending_colour_c8;
+	cursor_fb = nw->pending_cursor_fb;
+	overlay_fb = nw->pending_overlay_fb;
+	nw->pending_fb = NULL;
+	nw->pending_full = false;
+	memset(nw->pending_colour, 0, sizeof(nw->pending_colour));
+	nw->pending_colour_set = false;
+	nw->pending_cursor_fb = NULL;
+	nw->pending_cursor_set = false;
+	nw->pending_overlay_fb = NULL;
+	nw->pending_overlay_set = false;
+	spin_unlock(&nw->pending_lock);
+
+	if (colour_set) {
+		nw_spifb_load_colour(nw, colour, colour_c8);
+		nw_spifb_put_colour(colour);
+	}
+	/* Enable queues the cursor and overlay afresh from their states */
+	if (cursor_fb)
+		drm_framebuffer_put(cursor_fb);
+	if (overlay_fb)
+		drm_framebuffer_put(overlay_fb);
+	nw_spifb_load_overlay(nw, &hidden, NULL);
+	if (fb)
+		drm_framebuffer_put(fb);
+
+	/*
+	 * The worker may have set field_followup again before it was
+	 * cancelled. Enable sends a full frame, which is what the LCD was
+	 * owed.
+	 */
+	nw->field_owed = DRM_RECT_INIT(0, 0, 0, 0);
+	WRITE_ONCE(nw->field_followup, false);
+}
+
+static void nw_spifb_pipe_enable(struct drm_simple_display_pipe *pipe,
+				 struct drm_crtc_state *crtc_state,
+				 struct drm_plane_state *plane_state)
+{
+	struct nw_spifb *nw = drm_to_nw(pipe->crtc.dev);
+	struct drm_rect full, moved;
+
+	nw_spifb_set_vmode(nw, &crtc_state->mode);
+	full = DRM_RECT_INIT(0, 0, nw->vwidth, nw->vheight);
+
+	/* Send initial frame */
+	WRITE_ONCE(nw->field_stop, false);
+	nw_spifb_queue_colour(nw, crtc_state, plane_state->fb);
+	nw_spifb_queue_cursor(nw, NULL, nw->cursor_plane.state, &moved);
+	nw_spifb_queue_overlay(nw, NULL, nw->overlay_plane.state);
+	nw_spifb_queue_frame(nw, plane_state->fb, &full, true);
+
+	drm_crtc_vblank_on(&pipe->crtc);
+}
+
+static void nw_spifb_pipe_disable(struct drm_simple_display_pipe *pipe)
+{
+	struct nw_spifb *nw = drm_to_nw(pipe->crtc.dev);
+
+	drm_crtc_vblank_off(&pipe->crtc);
+	nw_spifb_cancel_frames(nw);
+	nw_spifb_drain(nw);
+	cancel_work_sync(&nw->work);
+}
+
+static void nw_spifb_pipe_update(struct drm_simple_display_pipe *pipe,
+				 struct drm_plane_state *old_state)
+{
+	struct drm_plane_state *state = pipe->plane.state;
+	struct drm_crtc *crtc = &pipe->crtc;
+	struct drm_pending_vblank_event *event = crtc->state->event;
+	struct drm_rect rect, moved;
+	struct nw_spifb *nw = drm_to_nw(crtc->dev);
+	struct drm_plane_state *cursor, *overlay;
+	bool recolour = false, damaged = false;
+	bool primary_idle = false, cursor_moved = false;
+	bool overlay_changed = false;
+	bool queue;
+
+	/*
+	 * On a modeset this runs before enable, which first switches the
+	 * scaler to the new mode and then queues a full frame itself.
+	 */
+	queue = crtc->state->active && !drm_atomic_crtc_needs_modeset(crtc->state);
+
+	/* New colour management (or a new C8 palette) recolours it all */
+	if (queue && crtc->state->color_mgmt_changed) {
+		nw_spifb_queue_colour(nw, crtc->state, state->fb);
+		recolour = !!state->fb;
+	}
+
+	/*
+	 * Cursor and overlay changes come with this update, the CRTC check
+	 * sees to it. The worker works out what an overlay change damages.
+	 */
+	cursor = drm_atomic_get_new_plane_state(old_state->state,
+						&nw->cursor_plane);
+	if (queue && cursor) {
+		primary_idle = to_nw_plane_state(cursor)->primary_idle;
+		cursor_moved = nw_spifb_queue_cursor(nw,
+			drm_atomic_get_old_plane_state(old_state->state,
+						       &nw->cursor_plane),
+			cursor, &moved);
+	}
+	overlay = drm_atomic_get_new_plane_state(old_state->state,
+						 &nw->overlay_plane);
+	if (queue && overlay) {
+		primary_idle |= to_nw_plane_state(overlay)->primary_idle;
+		overlay_changed = nw_spifb_queue_overlay(nw,
+			drm_atomic_get_old_plane_state(old_state->state,
+						       &nw->overlay_plane),
+			overlay);
+	}
+
+	if (recolour) {
+		rect = DRM_RECT_INIT(0, 0, nw->vwidth, nw->vheight);
+		damaged = true;
+	} else if (!primary_idle) {
+		damaged = drm_atomic_helper_damage_merged(old_state, state, &rect);
+	}
+	if (cursor_moved) {
+		if (damaged)
+			nw_spifb_rect_union(&rect, &moved);
+		else
+			rect = moved;
+		damaged = true;
+	}
+	if (queue && !damaged && overlay_changed) {
+		rect = DRM_RECT_INIT(0, 0, 0, 0);
+		damaged = true;
+	}
+	if (queue && damaged)
+		nw_spifb_queue_frame(nw, state->fb, &rect, false);
+
+	/*
+	 * The flip completes at the next vblank: when the transfer in
+	 * flight ends and the worker can start on this frame, or on a
+	 * timer tick if the bus is idle.
+	 */
+	if (event) {
+		crtc->state->event = NULL;
+
+		spin_lock_irq(&crtc->dev->event_lock);
+		if (crtc->state->active && drm_crtc_vblank_get(crtc) == 0)
+			drm_crtc_arm_vblank_event(crtc, event);
+		else
+			drm_crtc_send_vblank_event(crtc, event);
+		spin_unlock_irq(&crtc->dev->event_lock);
+	}
+}
+
+static int nw_spifb_pipe_enable_vblank(struct drm_simple_display_pipe *pipe)
+{
+	struct nw_spifb *nw = drm_to_nw(pipe->crtc.dev);
+
+	WRITE_ONCE(nw->vblank_on, true);
+	hrtimer_start(&nw->vblank_timer, ns_to_ktime(nw->frame_ns),
+		      HRTIMER_MODE_REL);
+
+	return 0;
+}
+
+/*
+ * Called with vblank locks held, so the timer cannot be waited for; it
+ * sees vblank_on cleared and stops by itself.
+ */
+static void nw_spifb_pipe_disable_vblank(struct drm_simple_display_pipe *pipe)
+{
+	struct nw_spifb *nw = drm_to_nw(pipe->crtc.dev);
+
+	WRITE_ONCE(nw->vblank_on, false);
+	hrtimer_try_to_cancel(&nw->vblank_timer);
+}
+
+static const struct drm_simple_display_pipe_funcs nw_spifb_pipe_funcs = {
+	.mode_valid	= nw_spifb_pipe_mode_valid,
+	.check		= nw_spifb_pipe_check,
+	.enable		= nw_spifb_pipe_enable,
+	.disable	= nw_spifb_pipe_disable,
+	.update		= nw_spifb_pipe_update,
+	.enable_vblank	= nw_spifb_pipe_enable_vblank,
+	.disable_vblank	= nw_spifb_pipe_disable_vblank,
+};
+
+/* --- Cursor and overlay planes --- */
+
+static int nw_spifb_cursor_atomic_check(struct drm_plane *plane,
+					struct drm_atomic_state *state)
+{
+	struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+	struct nw_spifb *nw = drm_to_nw(plane->dev);
+	struct drm_crtc_state *crtc_state = NULL;
+	int ret;
+
+	if (new_state->crtc)
+		crtc_state = drm_atomic_get_new_crtc_state(state, new_state->crtc);
+
+	ret = drm_atomic_helper_check_plane_state(new_state, crtc_state,
+						  DRM_PLANE_NO_SCALING,
+						  DRM_PLANE_NO_SCALING,
+						  true, true);
+	if (ret)
+		return ret;
+
+	to_nw_plane_state(new_state)->primary_idle =
+		!drm_atomic_get_new_plane_state(state, &nw->pipe.plane);
+
+	if (!new_state->visible)
+		return 0;
+
+	/* The whole image from its top-left pixel, as the cache holds it */
+	if (new_state->src_x || new_state->src_y ||
+	    (new_state->src_w >> 16) > NW_SPIFB_CURSOR_MAX ||
+	    (new_state->src_h >> 16) > NW_SPIFB_CURSOR_MAX ||
+	    (new_state->src_w | new_state->src_h) & 0xffff)
+		return -EINVAL;
+
+	return 0;
+}
+
+/*
+ * The overlay may be scaled either way and placed anywhere; what hangs
+ * over the frame is clipped off here, so the worker never sees it.
+ */
+static int nw_spifb_overlay_atomic_check(struct drm_plane *plane,
+					 struct drm_atomic_state *state)
+{
+	struct drm_plane_state *new_state = drm_atomic_get_new_plane_state(state, plane);
+	struct nw_spifb *nw = drm_to_nw(plane->dev);
+	struct drm_crtc_state *crtc_state = NULL;
+	int ret;
+
+	if (new_state->crtc)
+		crtc_state = drm_atomic_get_new_crtc_state(state, new_state->crtc);
+
+	ret = drm_atomic_helper_check_plane_state(new_state, crtc_state,
+						  OVERLAY_MIN_SCALE,
+						  OVERLAY_MAX_SCALE,
+						  true, true);
+	if (ret)
+		return ret;
+
+	to_nw_plane_state(new_state)->primary_idle =
+		!drm_atomic_get_new_plane_state(state, &nw->pipe.plane);
+
+	return 0;
+}
+
+/* Nothing to do here: the pipe update queues cursor and overlay changes */
+static void nw_spifb_plane_atomic_update(struct drm_plane *plane,
+					 struct drm_atomic_state *state)
+{
+}
+
+static const struct drm_plane_helper_funcs nw_spifb_cursor_helper_funcs = {
+	.atomic_check	= nw_spifb_cursor_atomic_check,
+	.atomic_update	= nw_spifb_plane_atomic_update,
+};
+
+static const struct drm_plane_helper_funcs nw_spifb_overlay_helper_funcs = {
+	.atomic_check	= nw_spifb_overlay_atomic_check,
+	.atomic_update	= nw_spifb_plane_atomic_update,
+};
+
+static void nw_spifb_plane_destroy_state(struct drm_plane *plane,
+					 struct drm_plane_state *state)
+{
+	__drm_atomic_helper_plane_destroy_state(state);
+	kfree(to_nw_plane_state(state));
+}
+
+static void nw_spifb_plane_reset(struct drm_plane *plane)
+{
+	struct nw_spifb_plane_state *state;
+
+	if (plane->state) {
+		nw_spifb_plane_destroy_state(plane, plane->state);
+		plane->state = NULL;
+	}
+
+	state = kzalloc(sizeof(*state), GFP_KERNEL);
+	if (state)
+		__drm_atomic_helper_plane_reset(plane, &state->base);
+}
+
+static struct drm_plane_state *
+nw_spifb_plane_duplicate_state(struct drm_plane *plane)
+{
+	struct nw_spifb_plane_state *state;
+
+	if (WARN_ON(!plane->state))
+		return NULL;
+
+	state = kzalloc(sizeof(*state), GFP_KERNEL);
+	if (!state)
+		return NULL;
+
+	__drm_atomic_helper_plane_duplicate_state(plane, &state->base);
+
+	return &state->base;
+}
+
+static const struct drm_plane_funcs nw_spifb_plane_funcs = {
+	.update_plane		= drm_atomic_helper_update_plane,
+	.disable_plane		= drm_atomic_helper_disable_plane,
+	.destroy		= drm_plane_cleanup,
+	.reset			= nw_spifb_plane_reset,
+	.atomic_duplicate_state	= nw_spifb_plane_duplicate_state,
+	.atomic_destroy_state	= nw_spifb_plane_destroy_state,
+};
+
+/* --- Connector --- */
+
+static int nw_spifb_connector_get_modes(struct drm_connector *connector)
+{
+	struct nw_spifb *nw = drm_to_nw(connector->dev);
+	struct drm_display_mode *mode;
+	u32 i;
+
+	for (i = 0; i < nw->num_vmodes; i++) {
+		u32 w = nw->vmodes[i].width;
+		u32 h = nw->vmodes[i].height;
+
+		mode = drm_mode_create(connector->dev);
+		if (!mode)
+			break;
+
+		mode->type = DRM_MODE_TYPE_DRIVER;
+		if (i == 0)
+			mode->type |= DRM_MODE_TYPE_PREFERRED;
+		mode->hdisplay = w;
+		mode->vdisplay = h;
+
+		/*
+		 * Timings are meaningless for SPI — we just need valid values.
+		 * SPI refresh is limited by bus speed, not pixel clock, so the
+		 * mode advertises the full-frame rate vblank is emulated at,
+		 * whatever the virtual resolution.
+		 */
+		mode->htotal = w + 1;
+		mode->hsync_start = w + 1;
+		mode->hsync_end = w + 1;
+		mode->vtotal = h + 1;
+		mode->vsync_start = h + 1;
+		mode->vsync_end = h + 1;
+		mode->clock = mode->htotal * mode->vtotal *
+			      DIV_ROUND_CLOSEST(NSEC_PER_SEC, nw->frame_ns) / 1000;
+
+		drm_mode_set_name(mode);
+		drm_mode_probed_add(connector, mode);
+	}
+
+	return i;
+}
+
+static const struct drm_connector_helper_funcs nw_spifb_connector_hfuncs = {
+	.get_modes = nw_spifb_connector_get_modes,
+};
+
+static const struct drm_connector_funcs nw_spifb_connector_funcs = {
+	.reset			= drm_atomic_helper_connector_reset,
+	.fill_modes		= drm_helper_probe_single_connector_modes,
+	.destroy		= drm_connector_cleanup,
+	.atomic_duplicate_state	= drm_atomic_helper_connector_duplicate_state,
+	.atomic_destroy_state	= drm_atomic_helper_connector_destroy_state,
+};
+
+/* --- Mode config --- */
+
+static const struct drm_mode_config_funcs nw_spifb_mode_config_funcs = {
+	.fb_create = drm_gem_fb_create_with_dirty,
+	.atomic_check = drm_atomic_helper_check,
+	.atomic_commit = drm_atomic_helper_commit,
+};
+
+/* --- debugfs --- */
+
+static int nw_spifb_stats_show(struct seq_file *m, void *data)
+{
+	struct drm_debugfs_entry *entry = m->private;
+	struct nw_spifb *nw = drm_to_nw(entry->dev);
+	struct nw_spifb_hist *hist;
+	int i;
+
+	seq_printf(m, "frames_sent: %lu\n", READ_ONCE(nw->frames_sent));
+	seq_printf(m, "frames_skipped: %lu\n", READ_ONCE(nw->frames_skipped));
+	seq_printf(m, "frames_dropped: %lu\n", READ_ONCE(nw->frames_dropped));
+	seq_printf(m, "bytes_sent: %lld\n", atomic64_read(&nw->bytes_sent));
+	seq_printf(m, "wire_format: v%u\n", nw->partial ? NW_SPIFB_WIRE_VERSION : 1);
+	seq_printf(m, "wire_depth: %u\n", nw->rgb332 ? 8 : 16);
+	seq_printf(m, "encoded_raw: %lu\n", READ_ONCE(nw->enc_frames[NW_SPIFB_ENC_RAW]));
+	seq_printf(m, "encoded_rle: %lu\n", READ_ONCE(nw->enc_frames[NW_SPIFB_ENC_RLE]));
+	seq_printf(m, "encoded_xor_rle: %lu\n",
+		   READ_ONCE(nw->enc_frames[NW_SPIFB_ENC_XOR_RLE]));
+	seq_printf(m, "zero_copy: %lu\n",
+		   READ_ONCE(nw->enc_frames[NW_SPIFB_ENC_RAW_LE]));
+	seq_printf(m, "encoded_rgb332: %lu\n",
+		   READ_ONCE(nw->enc_frames[NW_SPIFB_ENC_RGB332]));
+	seq_printf(m, "fields_sent: %lu\n", READ_ONCE(nw->fields_sent));
+
+	hist = kmalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return -ENOMEM;
+
+	/* Last NW_SPIFB_HIST_LEN frames per phase, in microseconds */
+	seq_printf(m, "%-8s %7s %7s %7s %7s\n", "phase_us", "samples", "p50",
+		   "p99", "max");
+	for (i = 0; i < NW_SPIFB_PHASES; i++) {
+		struct nw_spifb_hist_summary sum;
+
+		spin_lock_irq(&nw->stats_lock);
+		*hist = nw->hist[i];
+		spin_unlock_irq(&nw->stats_lock);
+
+		nw_spifb_hist_summarize(hist, &sum);
+		seq_printf(m, "%-8s %7u %7u %7u %7u\n", nw_spifb_phase_names[i],
+			   sum.samples, sum.p50, sum.p99, sum.max);
+	}
+
+	kfree(hist);
+
+	return 0;
+}
+
+/*
+ * debugfs 'converted': the last converted frame that was sent, as width
+ * x height big-endian RGB565, i.e. the TX buffer. That is not always
+ * what the LCD shows: an RGB332 wire sends it quantised, and a field
+ * only half of its rows. Each open copies it once, so reads and mmap()
+ * of one open file always see a single whole frame. Opening fails with
+ * -ENODATA while there is none, e.g. after zero-copy sends, which
+ * bypass the TX buffers.
+ */
+static int nw_spifb_frame_open(struct inode *inode, struct file *file)
+{
+	struct nw_spifb *nw = inode->i_private;
+	size_t size = nw->width * nw->height * 2;
+	void *snap;
+	int ret = 0;
+
+	snap = vmalloc_user(size);
+	if (!snap)
+		return -ENOMEM;
+
+	mutex_lock(&nw->capture_lock);
+	if (nw->sent_seq)
+		memcpy(snap, nw->tx_buf[!nw->tx_write], size);
+	else
+		ret = -ENODATA;
+	mutex_unlock(&nw->capture_lock);
+
+	if (ret) {
+		vfree(snap);
+		return ret;
+	}
+
+	file->private_data = snap;
+
+	return 0;
+}
+
+static ssize_t nw_spifb_frame_read(struct file *file, char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct nw_spifb *nw = file_inode(file)->i_private;
+
+	return simple_read_from_buffer(buf, count, ppos, file->private_data,
+				       nw->width * nw->height * 2);
+}
+
+static int nw_spifb_frame_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	return remap_vmalloc_range(vma, file->private_data, vma->vm_pgoff);
+}
+
+static int nw_spifb_frame_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+
+	return 0;
+}
+
+static const struct file_operations nw_spifb_frame_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nw_spifb_frame_open,
+	.read		= nw_spifb_frame_read,
+	.mmap		= nw_spifb_frame_mmap,
+	.llseek		= default_llseek,
+	.release	= nw_spifb_frame_release,
+};
+
+/*
+ * debugfs 'converted_seq': sequence number of the frame 'converted'
+ * holds, as in the drm_spifb tracepoints. Reading it before and after
+ * a capture tells whether a newer frame was sent in between.
+ */
+static int nw_spifb_frame_seq_show(struct seq_file *m, void *data)
+{
+	struct drm_debugfs_entry *entry = m->private;
+	struct nw_spifb *nw = drm_to_nw(entry->dev);
+	u64 seq;
+
+	mutex_lock(&nw->capture_lock);
+	seq = nw->sent_seq;
+	mutex_unlock(&nw->capture_lock);
+
+	seq_printf(m, "%llu\n", seq);
+
+	return 0;
+}
+
+static void nw_spifb_debugfs_init(struct drm_minor *minor)
+{
+	struct nw_spifb *nw = drm_to_nw(minor->dev);
+
+	debugfs_create_file_size("converted", 0444, minor->debugfs_root, nw,
+				 &nw_spifb_frame_fops,
+				 nw->width * nw->height * 2);
+}
+
+/* --- DRM driver --- */
+
+DEFINE_DRM_GEM_DMA_FOPS(nw_spifb_fops);
+
+static const struct drm_driver nw_spifb_drm_driver = {
+	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_ATOMIC,
+	.fops			= &nw_spifb_fops,
+	.debugfs_init		= nw_spifb_debugfs_init,
+	DRM_GEM_DMA_DRIVER_OPS_VMAP,
+	DRM_FBDEV_DMA_DRIVER_OPS,
+	.name			= DRIVER_NAME,
+	.desc			= DRIVER_DESC,
+	.major			= 1,
+	.minor			= 2,
+};
+
+/* --- SPI probe/remove --- */
+
+static const u32 nw_spifb_formats[] = {
+	DRM_FORMAT_RGB565,
+	DRM_FORMAT_XRGB8888,
+	DRM_FORMAT_ARGB8888,
+	DRM_FORMAT_C8,		/* Palette in the CRTC gamma LUT */
+	DRM_FORMAT_RGB332,
+	DRM_FORMAT_R8,		/* Greyscale */
+};
+
+/*
+ * Linear only, said explicitly so that a GPU renderer sharing its
+ * buffers through PRIME allocates them linear rather than tiled.
+ */
+static const u64 nw_spifb_modifiers[] = {
+	DRM_FORMAT_MOD_LINEAR,
+	DRM_FORMAT_MOD_INVALID,
+};
+
+static const u32 nw_spifb_cursor_formats[] = {
+	DRM_FORMAT_ARGB8888,
+};
+
+static const u32 nw_spifb_overlay_formats[] = {
+	DRM_FORMAT_NV12,
+	DRM_FORMAT_YUV420,
+	DRM_FORMAT_R8,		/* Monochrome sensors, e.g. the OV9281 */
+};
+
+/*
+ * Offer a virtual resolution, unless it is already on the list or the
+ * scaler cannot reach the physical one from it.
+ */
+static void nw_spifb_add_vmode(struct nw_spifb *nw, u32 width, u32 height)
+{
+	struct device *dev = &nw->spi->dev;
+	u32 i;
+
+	if (width * MAX_VUPSCALE < nw->width ||
+	    height * MAX_VUPSCALE < nw->height ||
+	    width > nw->width * MAX_VSCALE || height > nw->height * MAX_VSCALE) {
+		dev_warn(dev, "ignoring virtual mode %ux%u\n", width, height);
+		return;
+	}
+
+	for (i = 0; i < nw->num_vmodes; i++)
+		if (nw->vmodes[i].width == width &&
+		    nw->vmodes[i].height == height)
+			return;
+
+	if (nw->num_vmodes == MAX_VMODES) {
+		dev_warn(dev, "too many virtual modes, ignoring %ux%u\n",
+			 width, height);
+		return;
+	}
+
+	nw->vmodes[nw->num_vmodes++] = (struct nw_spifb_vmode){ width, height };
+	nw->max_vwidth = max(nw->max_vwidth, width);
+	nw->max_vheight = max(nw->max_vheight, height);
+}
+
+/*
+ * Build the mode list: the DT vwidth x vheight first (preferred), then
+ * the built-in modes, then DT 'virtual-modes' (width/height pairs).
+ */
+static int nw_spifb_init_vmodes(struct nw_spifb *nw)
+{
+	struct device *dev = &nw->spi->dev;
+	u32 pairs[2 * MAX_VMODES];
+	int i, n;
+
+	nw_spifb_add_vmode(nw, nw->vwidth, nw->vheight);
+	for (i = 0; i < ARRAY_SIZE(nw_spifb_default_vmodes); i++)
+		nw_spifb_add_vmode(nw, nw_spifb_default_vmodes[i].width,
+				   nw_spifb_default_vmodes[i].height);
+
+	n = device_property_count_u32(dev, "virtual-modes");
+	if (n > 0) {
+		n = min_t(int, n & ~1, ARRAY_SIZE(pairs));
+		if (device_property_read_u32_array(dev, "virtual-modes", pairs, n))
+			return -EINVAL;
+		for (i = 0; i < n; i += 2)
+			nw_spifb_add_vmode(nw, pairs[i], pairs[i + 1]);
+	}
+
+	return nw->num_vmodes ? 0 : -EINVAL;
+}
+
+static void nw_spifb_kvfree(struct drm_device *drm, void *ptr)
+{
+	kvfree(ptr);
+}
+
+static void nw_spifb_conv_state_release(struct drm_device *drm, void *ptr)
+{
+	drm_format_conv_state_release(ptr);
+}
+
+static int nw_spifb_probe(struct spi_device *spi)
+{
+	struct device *dev = &spi->dev;
+	struct nw_spifb *nw;
+	struct drm_device *drm;
+	u32 depth;
+	int i, ret;
+
+	nw = devm_drm_dev_alloc(dev, &nw_spifb_drm_driver,
+				struct nw_spifb, drm);
+	if (IS_ERR(nw))
+		return PTR_ERR(nw);
+
+	drm = &nw->drm;
+	nw->spi = spi;
+
+	/*
+	 * The SPI controller does the DMA, not this device, but dumb
+	 * buffers are allocated for it and PRIME imports (a GPU render
+	 * target, say) are mapped for it, both of which need a DMA mask.
+	 * Nothing ever uses the addresses: the CPU reads the buffers.
+	 */
+	if (!dev->coherent_dma_mask) {
+		ret = dma_coerce_mask_and_coherent(dev, DMA_BIT_MASK(32));
+		if (ret)
+			return ret;
+	}
+
+	/* Read display properties from DT (or drm-spifb-sink's software node) */
+	if (device_property_read_u32(dev, "width", &nw->width))
+		nw->width = 320;
+	if (device_property_read_u32(dev, "height", &nw->height))
+		nw->height = 240;
+	if (device_property_read_u32(dev, "vwidth", &nw->vwidth))
+		nw->vwidth = 480;	/* Default: 1.5x (480x360) */
+	if (device_property_read_u32(dev, "vheight", &nw->vheight))
+		nw->vheight = 360;
+
+	/* Starts out in the preferred mode: the DT one, unless rejected */
+	ret = nw_spifb_init_vmodes(nw);
+	if (ret)
+		return ret;
+	nw->vwidth = nw->vmodes[0].width;
+	nw->vheight = nw->vmodes[0].height;
+
+	/* Needs calculator firmware that understands the v2 header */
+	nw->partial = device_property_read_bool(dev, "partial-update");
+
+	/* RGB332 pixels only exist in v2 messages */
+	if (!device_property_read_u32(dev, "wire-depth", &depth) &&
+	    depth != 16) {
+		if (depth == 8 && nw->partial)
+			nw->rgb332 = true;
+		else
+			dev_warn(dev, "ignoring wire-depth %u\n", depth);
+	}
+
+	/* Table sizes depend on the physical resolution only */
+	nw->scaler_tables = devm_kcalloc(dev,
+					 nw_spifb_scaler_table_len(nw->width, nw->height),
+					 sizeof(*nw->scaler_tables), GFP_KERNEL);
+	if (!nw->scaler_tables)
+		return -ENOMEM;
+
+	for (i = 0; i < MAX_CONV_BANDS; i++) {
+		struct nw_spifb_band *band = &nw->band[i];
+
+		band->nw = nw;
+		INIT_WORK(&band->work, nw_spifb_band_work);
+		band->scratch = devm_kzalloc(dev, nw_spifb_scratch_size(nw->max_vwidth),
+					     GFP_KERNEL);
+		if (!band->scratch)
+			return -ENOMEM;
+
+		drm_format_conv_state_init(&band->fmtcnv_state);
+		ret = drmm_add_action_or_reset(drm, nw_spifb_conv_state_release,
+					       &band->fmtcnv_state);
+		if (ret)
+			return ret;
+	}
+
+	nw_spifb_scaler_init(&nw->scaler, nw->scaler_tables, nw->width,
+			     nw->height, nw->vwidth, nw->vheight);
+
+	nw_spifb_palette_grey(&nw->c8_palette);
+	nw_spifb_palette_rgb332(&nw->rgb332_palette);
+	nw_spifb_palette_grey(&nw->grey_palette);
+
+	/* Allocate two TX buffers for double buffering (cached for fast CPU writes) */
+	nw->tx_buf[0] = devm_kzalloc(dev, nw->width * nw->height * 2,
+				      GFP_KERNEL);
+	if (!nw->tx_buf[0])
+		return -ENOMEM;
+
+	nw->tx_buf[1] = devm_kzalloc(dev, nw->width * nw->height * 2,
+				      GFP_KERNEL);
+	if (!nw->tx_buf[1])
+		return -ENOMEM;
+
+	nw->tx_write = 0;
+
+	if (nw->partial) {
+		size_t len = nw_spifb_wire_max_len(nw->width, nw->height);
+
+		nw->wire_buf[0] = devm_kzalloc(dev, len, GFP_KERNEL);
+		nw->wire_buf[1] = devm_kzalloc(dev, len, GFP_KERNEL);
+		nw->zc_hdr = devm_kzalloc(dev, sizeof(*nw->zc_hdr), GFP_KERNEL);
+		if (!nw->wire_buf[0] || !nw->wire_buf[1] || !nw->zc_hdr)
+			return -ENOMEM;
+	}
+
+	/* Staging buffer for the largest virtual framebuffer (up to 32 bpp) */
+	nw->staging_pitch = nw->vwidth * 4;
+	nw->staging = kvzalloc(nw->max_vwidth * 4 * nw->max_vheight, GFP_KERNEL);
+	if (!nw->staging)
+		return -ENOMEM;
+	ret = drmm_add_action_or_reset(drm, nw_spifb_kvfree, nw->staging);
+	if (ret)
+		return ret;
+
+	nw->colour_table = kvmalloc_array(NW_SPIFB_COLOUR_TABLE_LEN,
+					  sizeof(*nw->colour_table), GFP_KERNEL);
+	if (!nw->colour_table)
+		return -ENOMEM;
+	ret = drmm_add_action_or_reset(drm, nw_spifb_kvfree, nw->colour_table);
+	if (ret)
+		return ret;
+
+	/* Start with completion signaled (no transfer in flight) */
+	init_completion(&nw->tx_done);
+	complete(&nw->tx_done);
+
+	/* One frame on the bus: what vblank is paced at when idle */
+	nw->frame_ns = SPI_XFER_OVERHEAD_NS;
+	if (spi->max_speed_hz)
+		nw->frame_ns += div_u64((u64)nw->width * nw->height *
+					(nw->rgb332 ? 8 : 16) *
+					NSEC_PER_SEC, spi->max_speed_hz);
+	else
+		nw->frame_ns = NSEC_PER_SEC / 60;
+	hrtimer_init(&nw->vblank_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	nw->vblank_timer.function = nw_spifb_vblank_timer;
+
+	INIT_WORK(&nw->work, nw_spifb_work);
+	spin_lock_init(&nw->pending_lock);
+	spin_lock_init(&nw->stats_lock);
+	ret = drmm_mutex_init(drm, &nw->capture_lock);
+	if (ret)
+		return ret;
+
+	/* DRM mode config */
+	ret = drmm_mode_config_init(drm);
+	if (ret)
+		return ret;
+
+	drm->mode_config.funcs = &nw_spifb_mode_config_funcs;
+	drm->mode_config.min_width = DIV_ROUND_UP(nw->width, MAX_VUPSCALE);
+	drm->mode_config.max_width = nw->max_vwidth;
+	drm->mode_config.min_height = DIV_ROUND_UP(nw->height, MAX_VUPSCALE);
+	drm->mode_config.max_height = nw->max_vheight;
+
+	/* Connector */
+	ret = drm_connector_init(drm, &nw->connector,
+				 &nw_spifb_connector_funcs,
+				 DRM_MODE_CONNECTOR_SPI);
+	if (ret)
+		return ret;
+
+	drm_connector_helper_add(&nw->connector, &nw_spifb_connector_hfuncs);
+
+	/* Simple display pipe (CRTC + encoder + plane) */
+	ret = drm_simple_display_pipe_init(drm, &nw->pipe,
+					   &nw_spifb_pipe_funcs,
+					   nw_spifb_formats,
+					   ARRAY_SIZE(nw_spifb_formats),
+					   nw_spifb_modifiers,
+					   &nw->connector);
+	if (ret)
+		return ret;
+
+	drm_plane_enable_fb_damage_clips(&nw->pipe.plane);
+
+	/*
+	 * Overlay plane for YUV video such as a camera viewfinder, which
+	 * the worker converts and scales along with the primary.
+	 */
+	ret = drm_universal_plane_init(drm, &nw->overlay_plane,
+				       drm_crtc_mask(&nw->pipe.crtc),
+				       &nw_spifb_plane_funcs,
+				       nw_spifb_overlay_formats,
+				       ARRAY_SIZE(nw_spifb_overlay_formats),
+				       nw_spifb_modifiers, DRM_PLANE_TYPE_OVERLAY,
+				       NULL);
+	if (ret)
+		return ret;
+	drm_plane_helper_add(&nw->overlay_plane, &nw_spifb_overlay_helper_funcs);
+	drm_plane_enable_fb_damage_clips(&nw->overlay_plane);
+	ret = drm_plane_create_color_properties(&nw->overlay_plane,
+						BIT(DRM_COLOR_YCBCR_BT601) |
+						BIT(DRM_COLOR_YCBCR_BT709),
+						BIT(DRM_COLOR_YCBCR_LIMITED_RANGE) |
+						BIT(DRM_COLOR_YCBCR_FULL_RANGE),
+						DRM_COLOR_YCBCR_BT601,
+						DRM_COLOR_YCBCR_LIMITED_RANGE);
+	if (ret)
+		return ret;
+
+	/*
+	 * Cursor plane, for atomic clients: drm_simple_display_pipe
+	 * creates the CRTC without one, so legacy cursor ioctls stay
+	 * unsupported and X falls back to a software cursor.
+	 */
+	ret = drm_universal_plane_init(drm, &nw->cursor_plane,
+				       drm_crtc_mask(&nw->pipe.crtc),
+				       &nw_spifb_plane_funcs,
+				       nw_spifb_cursor_formats,
+				       ARRAY_SIZE(nw_spifb_cursor_formats),
+				       nw_spifb_modifiers, DRM_PLANE_TYPE_CURSOR,
+				       NULL);
+	if (ret)
+		return ret;
+	drm_plane_helper_add(&nw->cursor_plane, &nw_spifb_cursor_helper_funcs);
+	drm_plane_enable_fb_damage_clips(&nw->cursor_plane);
+	drm->mode_config.cursor_width = NW_SPIFB_CURSOR_MAX;
+	drm->mode_config.cursor_height = NW_SPIFB_CURSOR_MAX;
+
+	/*
+	 * The gamma LUT is the C8 palette, legacy and atomic alike; other
+	 * formats get degamma, CTM and gamma through the colour table.
+	 */
+	ret = drm_mode_crtc_set_gamma_size(&nw->pipe.crtc, NW_SPIFB_PALETTE_LEN);
+	if (ret)
+		return ret;
+	drm_crtc_enable_color_mgmt(&nw->pipe.crtc, NW_SPIFB_COLOUR_LUT_LEN, true,
+				   NW_SPIFB_PALETTE_LEN);
+
+	ret = drm_vblank_init(drm, 1);
+	if (ret)
+		return ret;
+
+	drm_mode_config_reset(drm);
+
+	drm_debugfs_add_file(drm, "stats", nw_spifb_stats_show, NULL);
+	drm_debugfs_add_file(drm, "converted_seq", nw_spifb_frame_seq_show, NULL);
+
+	ret = drm_dev_register(drm, 0);
+	if (ret)
+		return ret;
+
+	spi_set_drvdata(spi, drm);
+
+	/* fbdev emulation — provides /dev/fb0 for legacy console/apps */
+	drm_fbdev_dma_setup(drm, 16);
+
+	dev_info(dev, "NumWorks SPI display: %ux%u (virtual %ux%u, %u modes up to %ux%u) @ SPI max %u Hz, wire v%u, %u bpp\n",
+		 nw->width, nw->height, nw->vwidth, nw->vheight,
+		 nw->num_vmodes, nw->max_vwidth, nw->max_vheight,
+		 spi->max_speed_hz, nw->partial ? NW_SPIFB_WIRE_VERSION : 1,
+		 nw->rgb332 ? 8 : 16);
+
+	return 0;
+}
+
+static void nw_spifb_remove(struct spi_device *spi)
+{
+	struct drm_device *drm = spi_get_drvdata(spi);
+	struct nw_spifb *nw = drm_to_nw(drm);
+
+	drm_dev_unplug(drm);
+	nw_spifb_cancel_frames(nw);
+	WRITE_ONCE(nw->vblank_on, false);
+	hrtimer_cancel(&nw->vblank_timer);
+	nw_spifb_drain(nw);
+	cancel_work_sync(&nw->work);
+}
+
+static void nw_spifb_shutdown(struct spi_device *spi)
+{
+	drm_atomic_helper_shutdown(spi_get_drvdata(spi));
+}
+
+static const struct of_device_id nw_spifb_of_match[] = {
+	{ .compatible = "numworks,spifb" },
+	{ }
+};
+MODULE_DEVICE_TABLE(of, nw_spifb_of_match);
+
+static const struct spi_device_id nw_spifb_id[] = {
+	{ "spifb", 0 },
+	{ }
+};
+MODULE_DEVICE_TABLE(spi, nw_spifb_id);
+
+static struct spi_driver nw_spifb_spi_driver = {
+	.driver = {
+		.name		= DRIVER_NAME,
+		.of_match_table	= nw_spifb_of_match,
+	},
+	.id_table	= nw_spifb_id,
+	.probe		= nw_spifb_probe,
+	.remove		= nw_spifb_remove,
+	.shutdown	= nw_spifb_shutdown,
+};
+module_spi_driver(nw_spifb_spi_driver);
+
+MODULE_DESCRIPTION(DRIVER_DESC);
+MODULE_AUTHOR("Martin");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * NEON box-filter kernels for drm-spifb
+ *
+ * Built with FPU flags (see Makefile), so nothing here may be called
+ * outside kernel_neon_begin()/kernel_neon_end(). Each kernel matches
+ * its scalar counterpart in drm-spifb-pixel.c bit for bit.
+ *
+ * XRGB8888 is loaded with VLD4 so each colour channel lands in its own
+ * vector, the arithmetic runs per channel, and the result is packed to
+ * RGB565 with shift-right-insert and byte-swapped with VREV16.
+ */
+
+#include <asm/neon-intrinsics.h>
+
+#include "drm-spifb-pixel.h"
+
+/* Pack 8 pixels of 8-bit channels into big-endian RGB565 */
+static inline uint16x8_t nw_spifb_neon_pack(uint8x8_t r, uint8x8_t g,
+					    uint8x8_t b)
+{
+	uint16x8_t p = vshll_n_u8(r, 8);
+
+	p = vsriq_n_u16(p, vshll_n_u8(g, 8), 5);
+	p = vsriq_n_u16(p, vshll_n_u8(b, 8), 11);
+
+	return vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(p)));
+}
+
+/* nw_spifb_div3() on 8 lanes */
+static inline uint8x8_t nw_spifb_neon_div3(uint16x8_t t)
+{
+	uint32x4_t lo = vmull_n_u16(vget_low_u16(t), 21846);
+	uint32x4_t hi = vmull_n_u16(vget_high_u16(t), 21846);
+
+	return vmovn_u16(vcombine_u16(vrshrn_n_u32(lo, 16),
+				      vrshrn_n_u32(hi, 16)));
+}
+
+/* (2 * heavy + light) / 3 */
+static inline uint8x8_t nw_spifb_neon_mix3(uint8x8_t heavy, uint8x8_t light)
+{
+	return nw_spifb_neon_div3(vmlal_u8(vmovl_u8(light), heavy,
+					   vdup_n_u8(2)));
+}
+
+/* 16 source pixels of two rows -> 8 outputs, 2x2 averaged */
+u32 nw_spifb_neon_box_2_1(u16 *dst, const u8 *r0, const u8 *r1, u32 w)
+{
+	u32 x;
+
+	for (x = 0; x + 8 <= w; x += 8, r0 += 64, r1 += 64) {
+		uint8x16x4_t a = vld4q_u8(r0);
+		uint8x16x4_t b = vld4q_u8(r1);
+		uint16x8_t sb = vpadalq_u8(vpaddlq_u8(a.val[0]), b.val[0]);
+		uint16x8_t sg = vpadalq_u8(vpaddlq_u8(a.val[1]), b.val[1]);
+		uint16x8_t sr = vpadalq_u8(vpaddlq_u8(a.val[2]), b.val[2]);
+
+		vst1q_u16(dst + x, nw_spifb_neon_pack(vrshrn_n_u16(sr, 2),
+						      vrshrn_n_u16(sg, 2),
+						      vrshrn_n_u16(sb, 2)));
+	}
+
+	return x;
+}
+
+/*
+ * 24 source pixels of two rows -> 16 outputs. Vertical weighting first,
+ * then VTBL splits each channel into the three phases of the triplet.
+ */
+u32 nw_spifb_neon_box_3_2(u16 *dst, const u8 *heavy, const u8 *light, u32 w)
+{
+	static const u8 phase[3][8] = {
+		{ 0, 3, 6, 9, 12, 15, 18, 21 },
+		{ 1, 4, 7, 10, 13, 16, 19, 22 },
+		{ 2, 5, 8, 11, 14, 17, 20, 23 },
+	};
+	uint8x8_t idx0 = vld1_u8(phase[0]);
+	uint8x8_t idx1 = vld1_u8(phase[1]);
+	uint8x8_t idx2 = vld1_u8(phase[2]);
+	u32 x;
+
+	for (x = 0; x + 16 <= w; x += 16, heavy += 96, light += 96) {
+		uint8x8x4_t h[3], l[3];
+		uint8x8_t even[3], odd[3];
+		int c, i;
+
+		for (i = 0; i < 3; i++) {
+			h[i] = vld4_u8(heavy + 32 * i);
+			l[i] = vld4_u8(light + 32 * i);
+		}
+
+		for (c = 0; c < 3; c++) {
+			uint8x8x3_t v;
+			uint8x8_t p0, p1, p2;
+
+			for (i = 0; i < 3; i++)
+				v.val[i] = nw_spifb_neon_mix3(h[i].val[c],
+							      l[i].val[c]);
+
+			p0 = vtbl3_u8(v, idx0);
+			p1 = vtbl3_u8(v, idx1);
+			p2 = vtbl3_u8(v, idx2);
+
+			even[c] = nw_spifb_neon_mix3(p0, p1);
+			odd[c] = nw_spifb_neon_mix3(p2, p1);
+		}
+
+		/* Channels are B, G, R in memory order */
+		vst2q_u16(dst + x, (uint16x8x2_t){ {
+			nw_spifb_neon_pack(even[2], even[1], even[0]),
+			nw_spifb_neon_pack(odd[2], odd[1], odd[0]),
+		} });
+	}
+
+	return x;
+}
+
+/* RGB565 -> XRGB8888 with bit replication, 8 pixels at a time */
+u32 nw_spifb_neon_expand_rgb565(u8 *dst, const u16 *src, u32 n)
+{
+	u32 i;
+
+	for (i = 0; i + 8 <= n; i += 8, dst += 32) {
+		uint16x8_t p = vld1q_u16(src + i);
+		uint8x8_t r = vshrn_n_u16(p, 8);
+		uint8x8_t g = vshrn_n_u16(p, 3);
+		uint8x8_t b = vshl_n_u8(vmovn_u16(p), 3);
+		uint8x8x4_t out;
+
+		out.val[0] = vsri_n_u8(b, b, 5);
+		out.val[1] = vsri_n_u8(g, g, 6);
+		out.val[2] = vsri_n_u8(r, r, 5);
+		out.val[3] = vdup_n_u8(0xff);
+		vst4_u8(dst, out);
+	}
+
+	return i;
+}
@@ -0,0 +1,834 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Pixel kernels for drm-spifb: scale + convert to big-endian RGB565.
+ *
+ * Two filters are provided:
+ *
+ *   nearest  Point sampling through precomputed coordinate tables, with
+ *            dedicated kernels for the 3:2, 2:1 and 1:2 ratios. Output
+ *            rows that sample the same source row as the one above,
+ *            which is every other row when upscaling 2x, are copies.
+ *
+ *   box      Area averaging. 2:1 averages each 2x2 block; 3:2 maps every
+ *            3x3 source block onto 2x2 outputs with (2,1)/3 and (1,2)/3
+ *            weights per axis. Other ratios, upscaling included, fall
+ *            back to bilinear.
+ *            Works on XRGB8888 rows; RGB565 and 8-bit rows are
+ *            expanded first.
+ *
+ * 8-bit sources (C8, and RGB332/R8 through fixed palettes) are looked
+ * up in a 256-entry palette: straight to big-endian RGB565 for nearest,
+ * to XRGB8888 for box.
+ *
+ * A YUV overlay is then drawn over the output, and a cursor blended
+ * over both, each sampled through the nearest tables whatever the
+ * filter.
+ *
+ * CRTC colour management comes last: degamma, matrix and gamma are
+ * folded into a table indexed by output pixel, so the whole of it is
+ * one lookup per converted pixel.
+ *
+ * The 3:2 and 2:1 box kernels have NEON versions in drm-spifb-neon.c.
+ * Each call into one is bracketed by kernel_neon_begin()/end() on its
+ * own, so preemption is only off for one row at a time, never for the
+ * scalar tails or the row expansion around it.
+ */
+
+#include <linux/string.h>
+
+#include "drm-spifb-pixel.h"
+
+#ifdef NW_SPIFB_HAVE_NEON
+#include <asm/neon.h>
+#endif
+
+static inline u16 nw_spifb_rgb_to_be565(u32 r, u32 g, u32 b)
+{
+	return cpu_to_be16(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+static inline u16 nw_spifb_xrgb8888_to_be565(u32 pix)
+{
+	return nw_spifb_rgb_to_be565((pix >> 16) & 0xff, (pix >> 8) & 0xff,
+				     pix & 0xff);
+}
+
+/* --- Nearest-neighbour row kernels --- */
+
+typedef void (*nw_spifb_row_fn)(u16 *dst, const void *src, const u16 *xmap,
+				u32 w);
+
+static void nw_spifb_row_xrgb8888(u16 *dst, const void *src, const u16 *xmap,
+				  u32 w)
+{
+	const u32 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x++)
+		dst[x] = nw_spifb_xrgb8888_to_be565(s[xmap[x]]);
+}
+
+/* 3:2 (480 -> 320): every 3 source pixels yield 2, taking the first two */
+static void nw_spifb_row_xrgb8888_3_2(u16 *dst, const void *src,
+				      const u16 *xmap, u32 w)
+{
+	const u32 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x += 2, s += 3) {
+		dst[x] = nw_spifb_xrgb8888_to_be565(s[0]);
+		dst[x + 1] = nw_spifb_xrgb8888_to_be565(s[1]);
+	}
+}
+
+/* 2:1 (640 -> 320): every other source pixel */
+static void nw_spifb_row_xrgb8888_2_1(u16 *dst, const void *src,
+				      const u16 *xmap, u32 w)
+{
+	const u32 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x++)
+		dst[x] = nw_spifb_xrgb8888_to_be565(s[2 * x]);
+}
+
+/* 1:2 (160 -> 320): each source pixel converted once, written twice */
+static void nw_spifb_row_xrgb8888_1_2(u16 *dst, const void *src,
+				      const u16 *xmap, u32 w)
+{
+	const u32 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x += 2, s++)
+		dst[x] = dst[x + 1] = nw_spifb_xrgb8888_to_be565(s[0]);
+}
+
+static void nw_spifb_row_rgb565(u16 *dst, const void *src, const u16 *xmap,
+				u32 w)
+{
+	const u16 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x++)
+		dst[x] = cpu_to_be16(s[xmap[x]]);
+}
+
+static void nw_spifb_row_rgb565_3_2(u16 *dst, const void *src,
+				    const u16 *xmap, u32 w)
+{
+	const u16 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x += 2, s += 3) {
+		dst[x] = cpu_to_be16(s[0]);
+		dst[x + 1] = cpu_to_be16(s[1]);
+	}
+}
+
+static void nw_spifb_row_rgb565_2_1(u16 *dst, const void *src,
+				    const u16 *xmap, u32 w)
+{
+	const u16 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x++)
+		dst[x] = cpu_to_be16(s[2 * x]);
+}
+
+static void nw_spifb_row_rgb565_1_2(u16 *dst, const void *src,
+				    const u16 *xmap, u32 w)
+{
+	const u16 *s = src;
+	u32 x;
+
+	for (x = 0; x < w; x += 2, s++)
+		dst[x] = dst[x + 1] = cpu_to_be16(s[0]);
+}
+
+/* Any ratio: one palette lookup per pixel is all there is to do */
+static void nw_spifb_row_c8(u16 *dst, const u8 *s, const u16 *xmap,
+			    const u16 *lut, u32 w)
+{
+	u32 x;
+
+	for (x = 0; x < w; x++)
+		dst[x] = lut[s[xmap[x]]];
+}
+
+static const nw_spifb_row_fn nw_spifb_xrgb8888_rows[] = {
+	[NW_SPIFB_RATIO_ANY]	= nw_spifb_row_xrgb8888,
+	[NW_SPIFB_RATIO_3_2]	= nw_spifb_row_xrgb8888_3_2,
+	[NW_SPIFB_RATIO_2_1]	= nw_spifb_row_xrgb8888_2_1,
+	[NW_SPIFB_RATIO_1_2]	= nw_spifb_row_xrgb8888_1_2,
+};
+
+static const nw_spifb_row_fn nw_spifb_rgb565_rows[] = {
+	[NW_SPIFB_RATIO_ANY]	= nw_spifb_row_rgb565,
+	[NW_SPIFB_RATIO_3_2]	= nw_spifb_row_rgb565_3_2,
+	[NW_SPIFB_RATIO_2_1]	= nw_spifb_row_rgb565_2_1,
+	[NW_SPIFB_RATIO_1_2]	= nw_spifb_row_rgb565_1_2,
+};
+
+/*
+ * Output row @y of rectangle [@x0, @x1) x [@y0, ...) samples the same
+ * source row as the one above it: copy that instead of converting.
+ */
+static bool nw_spifb_repeat_row(const struct nw_spifb_scaler *sc, u16 *dst,
+				u32 x0, u32 x1, u32 y0, u32 y)
+{
+	u16 *d = dst + y * sc->width + x0;
+
+	if (y == y0 || sc->ymap[y] != sc->ymap[y - 1])
+		return false;
+
+	memcpy(d, d - sc->width, (x1 - x0) * 2);
+	return true;
+}
+
+static void nw_spifb_nearest_rows(const struct nw_spifb_scaler *sc,
+				  const struct nw_spifb_src *src, u16 *dst,
+				  u32 x0, u32 y0, u32 x1, u32 y1)
+{
+	nw_spifb_row_fn row;
+	u32 cpp, sx0, y;
+
+	switch (src->format) {
+	case NW_SPIFB_SRC_XRGB8888:
+		row = nw_spifb_xrgb8888_rows[sc->ratio];
+		cpp = 4;
+		break;
+	case NW_SPIFB_SRC_RGB565:
+		row = nw_spifb_rgb565_rows[sc->ratio];
+		cpp = 2;
+		break;
+	case NW_SPIFB_SRC_C8:
+		for (y = y0; y < y1; y++)
+			if (!nw_spifb_repeat_row(sc, dst, x0, x1, y0, y))
+				nw_spifb_row_c8(dst + y * sc->width + x0,
+						src->base + sc->ymap[y] * src->pitch,
+						sc->xmap + x0, src->palette->be565,
+						x1 - x0);
+		return;
+	default:
+		return;
+	}
+
+	/* The fixed-ratio kernels start at the source of output column x0 */
+	switch (sc->ratio) {
+	case NW_SPIFB_RATIO_3_2:
+		sx0 = x0 / 2 * 3;
+		break;
+	case NW_SPIFB_RATIO_2_1:
+		sx0 = 2 * x0;
+		break;
+	case NW_SPIFB_RATIO_1_2:
+		sx0 = x0 / 2;
+		break;
+	default:
+		sx0 = 0;	/* Indexed through xmap + x0 */
+		break;
+	}
+
+	for (y = y0; y < y1; y++)
+		if (!nw_spifb_repeat_row(sc, dst, x0, x1, y0, y))
+			row(dst + y * sc->width + x0,
+			    src->base + sc->ymap[y] * src->pitch + sx0 * cpp,
+			    sc->xmap + x0, x1 - x0);
+}
+
+/* --- Box / bilinear kernels (XRGB8888 rows) --- */
+
+/* RGB565 -> XRGB8888 with bit replication, so white stays 0xffffff */
+static void nw_spifb_expand_rgb565(u32 *dst, const u16 *src, u32 n)
+{
+	u32 i = 0;
+
+#ifdef NW_SPIFB_HAVE_NEON
+	kernel_neon_begin();
+	i = nw_spifb_neon_expand_rgb565((u8 *)dst, src, n);
+	kernel_neon_end();
+#endif
+	for (; i < n; i++) {
+		u32 p = src[i];
+		u32 r = p >> 11, g = (p >> 5) & 0x3f, b = p & 0x1f;
+
+		dst[i] = 0xff000000 | ((r << 3 | r >> 2) << 16) |
+			 ((g << 2 | g >> 4) << 8) | (b << 3 | b >> 2);
+	}
+}
+
+/* 2:1 box: round((a + b + c + d) / 4) per channel */
+static void nw_spifb_box_2_1(u16 *dst, const u32 *r0, const u32 *r1, u32 w)
+{
+	u32 x = 0;
+
+#ifdef NW_SPIFB_HAVE_NEON
+	kernel_neon_begin();
+	x = nw_spifb_neon_box_2_1(dst, (const u8 *)r0, (const u8 *)r1, w);
+	kernel_neon_end();
+#endif
+	for (; x < w; x++) {
+		u32 a = r0[2 * x], b = r0[2 * x + 1];
+		u32 c = r1[2 * x], d = r1[2 * x + 1];
+		u32 ch[3], i;
+
+		for (i = 0; i < 3; i++) {
+			u32 s = 8 * (2 - i);
+
+			ch[i] = (((a >> s) & 0xff) + ((b >> s) & 0xff) +
+				 ((c >> s) & 0xff) + ((d >> s) & 0xff) + 2) >> 2;
+		}
+		dst[x] = nw_spifb_rgb_to_be565(ch[0], ch[1], ch[2]);
+	}
+}
+
+/* (2 * heavy + light) / 3 on each colour channel */
+static inline u32 nw_spifb_mix3(u32 heavy, u32 light)
+{
+	u32 out = 0, s;
+
+	for (s = 0; s <= 16; s += 8)
+		out |= nw_spifb_div3(2 * ((heavy >> s) & 0xff) +
+				     ((light >> s) & 0xff)) << s;
+	return out;
+}
+
+/*
+ * 3:2 box: the output row is already weighted toward @heavy by the
+ * caller's row choice; horizontally, pixel pairs take (2,1) and (1,2)
+ * weights from each source triplet.
+ */
+static void nw_spifb_box_3_2(u16 *dst, const u32 *heavy, const u32 *light,
+			     u32 w)
+{
+	u32 x = 0;
+
+#ifdef NW_SPIFB_HAVE_NEON
+	kernel_neon_begin();
+	x = nw_spifb_neon_box_3_2(dst, (const u8 *)heavy, (const u8 *)light, w);
+	kernel_neon_end();
+#endif
+	heavy += x / 2 * 3;
+	light += x / 2 * 3;
+	for (; x < w; x += 2, heavy += 3, light += 3) {
+		u32 v0 = nw_spifb_mix3(heavy[0], light[0]);
+		u32 v1 = nw_spifb_mix3(heavy[1], light[1]);
+		u32 v2 = nw_spifb_mix3(heavy[2], light[2]);
+
+		dst[x] = nw_spifb_xrgb8888_to_be565(nw_spifb_mix3(v0, v1));
+		dst[x + 1] = nw_spifb_xrgb8888_to_be565(nw_spifb_mix3(v2, v1));
+	}
+}
+
+static void nw_spifb_bilinear(u16 *dst, const u32 *r0, const u32 *r1,
+			      u32 fy, const struct nw_spifb_scaler *sc,
+			      u32 x0, u32 x1)
+{
+	u32 x;
+
+	for (x = x0; x < x1; x++) {
+		u32 i = sc->xmap_f[x], fx = sc->xfrac[x];
+		u32 ch[3], c;
+
+		for (c = 0; c < 3; c++) {
+			u32 s = 8 * (2 - c);
+			u32 top = ((r0[i] >> s) & 0xff) * (256 - fx) +
+				  ((r0[i + 1] >> s) & 0xff) * fx;
+			u32 bot = ((r1[i] >> s) & 0xff) * (256 - fx) +
+				  ((r1[i + 1] >> s) & 0xff) * fx;
+
+			ch[c] = (top * (256 - fy) + bot * fy + 32768) >> 16;
+		}
+		dst[x] = nw_spifb_rgb_to_be565(ch[0], ch[1], ch[2]);
+	}
+}
+
+/*
+ * Source row @sy as XRGB8888, expanding columns @sx0..@sx1 into @tmp if
+ * needed. Either way the result is indexed by source column.
+ */
+static const u32 *nw_spifb_xrgb_row(const struct nw_spifb_src *src, u32 sy,
+				    u32 sx0, u32 sx1, u32 *tmp)
+{
+	const u8 *row = src->base + sy * src->pitch;
+	u32 x;
+
+	switch (src->format) {
+	case NW_SPIFB_SRC_XRGB8888:
+		return (const u32 *)row;
+	case NW_SPIFB_SRC_RGB565:
+		nw_spifb_expand_rgb565(tmp + sx0, (const u16 *)row + sx0,
+				       sx1 - sx0);
+		break;
+	case NW_SPIFB_SRC_C8:
+		for (x = sx0; x < sx1; x++)
+			tmp[x] = src->palette->xrgb[row[x]];
+		break;
+	}
+	return tmp;
+}
+
+static void nw_spifb_box_rows(const struct nw_spifb_scaler *sc,
+			      const struct nw_spifb_src *src, u16 *dst,
+			      u32 x0, u32 y0, u32 x1, u32 y1, void *scratch)
+{
+	u32 *tmp0 = scratch, *tmp1 = tmp0 + sc->vwidth;
+	u32 sx0, sx1, y;
+
+	/* Source columns the output columns read */
+	switch (sc->ratio) {
+	case NW_SPIFB_RATIO_2_1:
+		sx0 = 2 * x0;
+		sx1 = 2 * x1;
+		break;
+	case NW_SPIFB_RATIO_3_2:
+		sx0 = x0 / 2 * 3;
+		sx1 = x1 / 2 * 3;
+		break;
+	default:
+		sx0 = sc->xmap_f[x0];
+		sx1 = sc->xmap_f[x1 - 1] + 2;
+		break;
+	}
+
+	for (y = y0; y < y1; y++) {
+		u16 *d = dst + y * sc->width;
+		const u32 *r0, *r1;
+		u32 base, sy;
+
+		switch (sc->ratio) {
+		case NW_SPIFB_RATIO_2_1:
+			r0 = nw_spifb_xrgb_row(src, 2 * y, sx0, sx1, tmp0);
+			r1 = nw_spifb_xrgb_row(src, 2 * y + 1, sx0, sx1, tmp1);
+			nw_spifb_box_2_1(d + x0, r0 + sx0, r1 + sx0, x1 - x0);
+			break;
+		case NW_SPIFB_RATIO_3_2:
+			/* Row 3i weighs 2 in even outputs, row 3i+2 in odd */
+			base = y / 2 * 3;
+			sy = (y & 1) ? base + 2 : base;
+			r0 = nw_spifb_xrgb_row(src, sy, sx0, sx1, tmp0);
+			r1 = nw_spifb_xrgb_row(src, base + 1, sx0, sx1, tmp1);
+			nw_spifb_box_3_2(d + x0, r0 + sx0, r1 + sx0, x1 - x0);
+			break;
+		default:
+			sy = sc->ymap_f[y];
+			r0 = nw_spifb_xrgb_row(src, sy, sx0, sx1, tmp0);
+			r1 = nw_spifb_xrgb_row(src, sy + 1, sx0, sx1, tmp1);
+			nw_spifb_bilinear(d, r0, r1, sc->yfrac[y], sc, x0, x1);
+			break;
+		}
+	}
+}
+
+/* --- Palettes for 8-bit sources --- */
+
+/* Set palette entry @index from 8-bit channels */
+void nw_spifb_palette_set(struct nw_spifb_palette *pal, u32 index,
+			  u32 r, u32 g, u32 b)
+{
+	pal->xrgb[index] = 0xff000000 | r << 16 | g << 8 | b;
+	pal->be565[index] = nw_spifb_rgb_to_be565(r, g, b);
+}
+
+/* RGB332, channels widened by bit replication like RGB565 */
+void nw_spifb_palette_rgb332(struct nw_spifb_palette *pal)
+{
+	u32 i;
+
+	for (i = 0; i < NW_SPIFB_PALETTE_LEN; i++) {
+		u32 r = i >> 5, g = (i >> 2) & 7, b = i & 3;
+
+		nw_spifb_palette_set(pal, i, r << 5 | r << 2 | r >> 1,
+				     g << 5 | g << 2 | g >> 1, b * 0x55);
+	}
+}
+
+/* R8 (and C8 without a gamma LUT): a linear grey ramp */
+void nw_spifb_palette_grey(struct nw_spifb_palette *pal)
+{
+	u32 i;
+
+	for (i = 0; i < NW_SPIFB_PALETTE_LEN; i++)
+		nw_spifb_palette_set(pal, i, i, i, i);
+}
+
+/*
+ * Bilinear sample positions: output pixel centres mapped into the source,
+ * in 1/256 pixel units. The left/top tap is clamped so its neighbour is
+ * always in range; the weight then moves entirely onto that neighbour.
+ */
+static void nw_spifb_bilinear_table(u16 *map, u16 *frac, u32 n, u32 vn)
+{
+	u32 i;
+
+	for (i = 0; i < n; i++) {
+		s32 pos = (s32)((2 * i + 1) * vn * 128 / n) - 128;
+		u32 p = pos < 0 ? 0 : pos;
+		u32 idx = p >> 8, f = p & 0xff;
+
+		if (idx >= vn - 1) {
+			idx = vn - 2;
+			f = 256;
+		}
+		map[i] = idx;
+		frac[i] = f;
+	}
+}
+
+/*
+ * Build the coordinate tables for a virtual -> physical ratio, replacing
+ * the per-pixel x * vw / w divide. The virtual size may be smaller than
+ * the physical one: the same tables then repeat source pixels, and the
+ * bilinear ones interpolate between them. @tables must hold
+ * nw_spifb_scaler_table_len() entries and outlive the scaler.
+ */
+void nw_spifb_scaler_init(struct nw_spifb_scaler *sc, u16 *tables,
+			  u32 width, u32 height, u32 vwidth, u32 vheight)
+{
+	u32 i;
+
+	sc->width = width;
+	sc->height = height;
+	sc->vwidth = vwidth;
+	sc->vheight = vheight;
+
+	sc->xmap = tables;
+	sc->xmap_f = sc->xmap + width;
+	sc->xfrac = sc->xmap_f + width;
+	sc->ymap = sc->xfrac + width;
+	sc->ymap_f = sc->ymap + height;
+	sc->yfrac = sc->ymap_f + height;
+
+	for (i = 0; i < width; i++)
+		sc->xmap[i] = i * vwidth / width;
+	for (i = 0; i < height; i++)
+		sc->ymap[i] = i * vheight / height;
+
+	nw_spifb_bilinear_table(sc->xmap_f, sc->xfrac, width, vwidth);
+	nw_spifb_bilinear_table(sc->ymap_f, sc->yfrac, height, vheight);
+
+	if (vwidth * 2 == width * 3 && vheight * 2 == height * 3 &&
+	    !(width & 1) && !(height & 1))
+		sc->ratio = NW_SPIFB_RATIO_3_2;
+	else if (vwidth == width * 2 && vheight == height * 2)
+		sc->ratio = NW_SPIFB_RATIO_2_1;
+	else if (vwidth * 2 == width && vheight * 2 == height)
+		sc->ratio = NW_SPIFB_RATIO_1_2;
+	else
+		sc->ratio = NW_SPIFB_RATIO_ANY;
+}
+
+/*
+ * Output span [*@d0, *@d1) that can change when source span [@s0, @s1)
+ * changes, along an axis scaled from @vn to @n pixels. Conservative for
+ * every filter: no kernel reads more than one source pixel beyond the
+ * area an output pixel covers.
+ */
+void nw_spifb_scaler_span(u32 s0, u32 s1, u32 vn, u32 n, u32 *d0, u32 *d1)
+{
+	if (vn == n) {
+		*d0 = s0;
+		*d1 = s1;
+		return;
+	}
+
+	*d0 = s0 ? (s0 - 1) * n / vn : 0;
+	*d1 = min(n, DIV_ROUND_UP((s1 + 1) * n, vn));
+}
+
+/*
+ * Scale output rectangle [@x0, @x1) x [@y0, @y1) of a vwidth x vheight
+ * source into @dst, a width x height big-endian RGB565 frame; the rest
+ * of @dst is left alone. At 3:2 and 1:2 the columns are widened to
+ * even bounds, since the kernels work on pixel pairs. @scratch must hold
+ * nw_spifb_scratch_size() bytes and is only touched by the box filter.
+ */
+void nw_spifb_scale_rect(const struct nw_spifb_scaler *sc,
+			 const struct nw_spifb_src *src, u16 *dst,
+			 u32 x0, u32 y0, u32 x1, u32 y1, void *scratch)
+{
+	/* At 1:1 every filter is a copy, so take the cheapest */
+	bool one_to_one = sc->vwidth == sc->width && sc->vheight == sc->height;
+
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	if (nw_spifb_scaler_pairs(sc)) {
+		x0 &= ~1;
+		x1 = (x1 + 1) & ~1;
+	}
+
+	if (sc->filter == NW_SPIFB_FILTER_BOX && !one_to_one)
+		nw_spifb_box_rows(sc, src, dst, x0, y0, x1, y1, scratch);
+	else
+		nw_spifb_nearest_rows(sc, src, dst, x0, y0, x1, y1);
+}
+
+/* Scale whole output rows [@y0, @y1), as nw_spifb_scale_rect() */
+void nw_spifb_scale_rows(const struct nw_spifb_scaler *sc,
+			 const struct nw_spifb_src *src, u16 *dst,
+			 u32 y0, u32 y1, void *scratch)
+{
+	nw_spifb_scale_rect(sc, src, dst, 0, y0, sc->width, y1, scratch);
+}
+
+/* --- Colour management --- */
+
+/* Identity LUTs and matrix: a table built from them changes nothing */
+void nw_spifb_colour_identity(struct nw_spifb_colour *c)
+{
+	u32 ch, i;
+
+	for (ch = 0; ch < 3; ch++) {
+		for (i = 0; i < NW_SPIFB_COLOUR_LUT_LEN; i++) {
+			c->degamma[ch][i] = i * 0xffff / (NW_SPIFB_COLOUR_LUT_LEN - 1);
+			c->gamma[ch][i] = c->degamma[ch][i];
+		}
+	}
+	for (i = 0; i < 9; i++)
+		c->ctm[i] = i % 4 ? 0 : 0x10000;
+}
+
+/*
+ * @lut at @v (0..0xffff), interpolating between its entries. @f is the
+ * position between entries in 1/0xffff units, so the blend divides by
+ * 0xffff too, rounded; both weighted terms together fit in a u32.
+ */
+static u32 nw_spifb_lut_sample(const u16 *lut, u32 v)
+{
+	u32 t = v * (NW_SPIFB_COLOUR_LUT_LEN - 1);
+	u32 i = t / 0xffff, f = t % 0xffff;
+
+	if (i == NW_SPIFB_COLOUR_LUT_LEN - 1)
+		return lut[i];
+	return (lut[i] * (0xffff - f) + lut[i + 1] * f + 0x7fff) / 0xffff;
+}
+
+/*
+ * Fold @c into @table, NW_SPIFB_COLOUR_TABLE_LEN entries mapping each
+ * big-endian RGB565 pixel to its colour-managed value, so applying it
+ * costs one lookup per pixel whatever the LUTs and matrix hold. Channels
+ * enter at 8 bits, widened by bit replication like the box filter does.
+ * Returns false if the table is the identity.
+ */
+bool nw_spifb_colour_table(u16 *table, const struct nw_spifb_colour *c)
+{
+	bool changed = false;
+	u32 i;
+
+	for (i = 0; i < NW_SPIFB_COLOUR_TABLE_LEN; i++) {
+		u32 p = be16_to_cpu(i);
+		u32 in[3] = {
+			(p >> 8 & 0xf8) | (p >> 13),
+			(p >> 3 & 0xfc) | (p >> 9 & 0x03),
+			(p << 3 & 0xf8) | (p >> 2 & 0x07),
+		};
+		u32 lin[3], out[3], ch;
+
+		for (ch = 0; ch < 3; ch++)
+			lin[ch] = c->degamma[ch][in[ch]];
+
+		for (ch = 0; ch < 3; ch++) {
+			const s32 *m = &c->ctm[3 * ch];
+			s64 v = ((s64)m[0] * lin[0] + (s64)m[1] * lin[1] +
+				 (s64)m[2] * lin[2]) >> 16;
+
+			out[ch] = nw_spifb_lut_sample(c->gamma[ch],
+						      clamp_t(s64, v, 0, 0xffff));
+		}
+
+		table[i] = cpu_to_be16((out[0] * 31 + 0x7fff) / 0xffff << 11 |
+				       (out[1] * 63 + 0x7fff) / 0xffff << 5 |
+				       (out[2] * 31 + 0x7fff) / 0xffff);
+		changed |= table[i] != i;
+	}
+
+	return changed;
+}
+
+/* Map output rectangle [@x0, @x1) x [@y0, @y1) of @dst through @table */
+void nw_spifb_colour_rect(const struct nw_spifb_scaler *sc, const u16 *table,
+			  u16 *dst, u32 x0, u32 y0, u32 x1, u32 y1)
+{
+	u32 x, y;
+
+	for (y = y0; y < y1; y++) {
+		u16 *d = dst + y * sc->width;
+
+		for (x = x0; x < x1; x++)
+			d[x] = table[d[x]];
+	}
+}
+
+/* --- Cursor --- */
+
+/* Rounded @t / 255 for @t up to 255 * 255 */
+static inline u32 nw_spifb_div255(u32 t)
+{
+	t += 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+/* Premultiplied ARGB8888 @src over big-endian RGB565 @dst */
+static inline u16 nw_spifb_blend_be565(u16 dst, u32 src)
+{
+	u32 ia = 255 - (src >> 24);
+	u32 d = be16_to_cpu(dst);
+	u32 r = (d >> 8 & 0xf8) | (d >> 13);
+	u32 g = (d >> 3 & 0xfc) | (d >> 9 & 0x03);
+	u32 b = (d << 3 & 0xf8) | (d >> 2 & 0x07);
+
+	r = min(((src >> 16) & 0xff) + nw_spifb_div255(r * ia), 255U);
+	g = min(((src >> 8) & 0xff) + nw_spifb_div255(g * ia), 255U);
+	b = min((src & 0xff) + nw_spifb_div255(b * ia), 255U);
+
+	return nw_spifb_rgb_to_be565(r, g, b);
+}
+
+/*
+ * Blend @cur over output rectangle [@x0, @x1) x [@y0, @y1) of @dst.
+ * Each output pixel takes the cursor pixel at its nearest source
+ * position, so a fully opaque or transparent pixel comes out exactly as
+ * if the cursor had been drawn into the source before nearest scaling.
+ * Translucent pixels are blended onto the RGB565 output, which is
+ * within one step of that.
+ */
+void nw_spifb_blend_cursor(const struct nw_spifb_scaler *sc,
+			   const struct nw_spifb_cursor *cur, u16 *dst,
+			   u32 x0, u32 y0, u32 x1, u32 y1)
+{
+	u32 x, y;
+
+	for (y = y0; y < y1; y++) {
+		s32 cy = (s32)sc->ymap[y] - cur->y;
+		const u32 *row;
+		u16 *d;
+
+		if (cy < 0 || cy >= (s32)cur->height)
+			continue;
+
+		row = cur->argb + cy * cur->width;
+		d = dst + y * sc->width;
+
+		for (x = x0; x < x1; x++) {
+			s32 cx = (s32)sc->xmap[x] - cur->x;
+			u32 p;
+
+			if (cx < 0 || cx >= (s32)cur->width)
+				continue;
+
+			p = row[cx];
+			if (!p)
+				continue;
+			d[x] = (p >> 24) == 0xff ? nw_spifb_xrgb8888_to_be565(p) :
+				nw_spifb_blend_be565(d[x], p);
+		}
+	}
+}
+
+/* --- YUV overlay --- */
+
+/*
+ * YCbCr -> RGB coefficients, scaled by 256: luma gain and offset, then
+ * the Cr term of red, the Cb and Cr terms of green and the Cb term of
+ * blue.
+ */
+struct nw_spifb_yuv_coeffs {
+	s32 y, yoff, rv, gu, gv, bu;
+};
+
+static const struct nw_spifb_yuv_coeffs nw_spifb_yuv_coeffs[] = {
+	[NW_SPIFB_BT601_LIMITED] = { 298, 16, 409, 100, 208, 516 },
+	[NW_SPIFB_BT601_FULL]	 = { 256,  0, 359,  88, 183, 454 },
+	[NW_SPIFB_BT709_LIMITED] = { 298, 16, 459,  55, 136, 541 },
+	[NW_SPIFB_BT709_FULL]	 = { 256,  0, 403,  48, 120, 475 },
+};
+
+static inline u16 nw_spifb_yuv_to_be565(const struct nw_spifb_yuv_coeffs *k,
+					u32 y, u32 u, u32 v)
+{
+	s32 c = ((s32)y - k->yoff) * k->y + 128;
+	s32 d = (s32)u - 128;
+	s32 e = (s32)v - 128;
+
+	return nw_spifb_rgb_to_be565(clamp((c + k->rv * e) >> 8, 0, 255),
+				     clamp((c - k->gu * d - k->gv * e) >> 8, 0, 255),
+				     clamp((c + k->bu * d) >> 8, 0, 255));
+}
+
+/* Output pixels [*@d0, *@d1) whose nearest source lies in [@s0, @s1) */
+static void nw_spifb_map_span(const u16 *map, u32 n, u32 s0, u32 s1,
+			      u32 *d0, u32 *d1)
+{
+	u32 i;
+
+	for (i = 0; i < n && map[i] < s0; i++)
+		;
+	*d0 = i;
+	for (; i < n && map[i] < s1; i++)
+		;
+	*d1 = i;
+}
+
+/*
+ * Output rectangle the overlay covers: every pixel in it is entirely
+ * replaced by nw_spifb_draw_overlay(), whatever the filter. Returns
+ * false if there is none.
+ */
+bool nw_spifb_overlay_span(const struct nw_spifb_scaler *sc,
+			   const struct nw_spifb_overlay *ov,
+			   u32 *x0, u32 *y0, u32 *x1, u32 *y1)
+{
+	nw_spifb_map_span(sc->xmap, sc->width, ov->x, ov->x + ov->width, x0, x1);
+	nw_spifb_map_span(sc->ymap, sc->height, ov->y, ov->y + ov->height, y0, y1);
+
+	return *x0 < *x1 && *y0 < *y1;
+}
+
+/*
+ * Draw @ov over output rectangle [@x0, @x1) x [@y0, @y1) of @dst, which
+ * must lie within its nw_spifb_overlay_span(). Each output pixel takes
+ * the overlay pixel at its nearest source position, scaled from there
+ * to the overlay's source window by nearest as well; chroma comes from
+ * the sample covering that luma pixel.
+ */
+void nw_spifb_draw_overlay(const struct nw_spifb_scaler *sc,
+			   const struct nw_spifb_overlay *ov, u16 *dst,
+			   u32 x0, u32 y0, u32 x1, u32 y1)
+{
+	const struct nw_spifb_yuv_coeffs *k = &nw_spifb_yuv_coeffs[ov->matrix];
+	u32 xstep = (ov->src_w << 16) / ov->width;
+	u32 ystep = (ov->src_h << 16) / ov->height;
+	u32 x, y;
+
+	for (y = y0; y < y1; y++) {
+		u32 sy = ov->src_y + (((sc->ymap[y] - ov->y) * ystep) >> 16);
+		const u8 *luma = ov->plane[0] + sy * ov->pitch[0];
+		const u8 *cb = NULL, *cr = NULL;
+		u16 *d = dst + y * sc->width;
+
+		if (ov->format != NW_SPIFB_YUV_GREY)
+			cb = ov->plane[1] + (sy / 2) * ov->pitch[1];
+		if (ov->format == NW_SPIFB_YUV_I420)
+			cr = ov->plane[2] + (sy / 2) * ov->pitch[2];
+
+		for (x = x0; x < x1; x++) {
+			u32 sx = ov->src_x + (((sc->xmap[x] - ov->x) * xstep) >> 16);
+			u32 l = luma[sx];
+
+			switch (ov->format) {
+			case NW_SPIFB_YUV_NV12:
+				d[x] = nw_spifb_yuv_to_be565(k, l, cb[sx & ~1],
+							     cb[sx | 1]);
+				break;
+			case NW_SPIFB_YUV_I420:
+				d[x] = nw_spifb_yuv_to_be565(k, l, cb[sx / 2],
+							     cr[sx / 2]);
+				break;
+			case NW_SPIFB_YUV_GREY:
+				d[x] = nw_spifb_rgb_to_be565(l, l, l);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Pixel kernels for drm-spifb
+ *
+ * Scale + convert a virtual-resolution source to the big-endian
+ * RGB565 the STM32 expects. Nothing in here knows about DRM: sources are
+ * plain (base, pitch, format) triples and the output is a width x height
+ * array of __be16 pixels.
+ */
+
+#ifndef __DRM_SPIFB_PIXEL_H__
+#define __DRM_SPIFB_PIXEL_H__
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+
+#if IS_ENABLED(CONFIG_KERNEL_MODE_NEON)
+#define NW_SPIFB_HAVE_NEON	1
+#endif
+
+/* Virtual -> physical ratios with dedicated scaler kernels */
+enum nw_spifb_ratio {
+	NW_SPIFB_RATIO_ANY,	/* Table-driven generic path */
+	NW_SPIFB_RATIO_3_2,	/* 480x360 -> 320x240 */
+	NW_SPIFB_RATIO_2_1,	/* 640x480 -> 320x240 */
+	NW_SPIFB_RATIO_1_2,	/* 160x120 -> 320x240 */
+};
+
+enum nw_spifb_filter {
+	NW_SPIFB_FILTER_NEAREST,	/* Point sampling */
+	NW_SPIFB_FILTER_BOX,		/* Area average (bilinear for odd ratios
+					 * and upscaling) */
+};
+
+enum nw_spifb_src_format {
+	NW_SPIFB_SRC_XRGB8888,
+	NW_SPIFB_SRC_RGB565,
+	NW_SPIFB_SRC_C8,	/* 8-bit index into src->palette */
+};
+
+#define NW_SPIFB_PALETTE_LEN	256
+
+/*
+ * Colours of an 8-bit source, in both forms the kernels consume. C8
+ * takes them from the CRTC gamma LUT; RGB332 and R8 are C8 with a
+ * fixed palette.
+ */
+struct nw_spifb_palette {
+	u32 xrgb[NW_SPIFB_PALETTE_LEN];		/* Box filter input */
+	u16 be565[NW_SPIFB_PALETTE_LEN];	/* Nearest output, ready to send */
+};
+
+struct nw_spifb_src {
+	const u8 *base;
+	u32 pitch;
+	enum nw_spifb_src_format format;
+	const struct nw_spifb_palette *palette;	/* NW_SPIFB_SRC_C8 only */
+};
+
+/* Largest cursor image, in either dimension */
+#define NW_SPIFB_CURSOR_MAX	64
+
+/*
+ * A cursor blended over converted output: premultiplied ARGB8888 (the
+ * DRM default blend mode) in virtual pixels, placed in the virtual
+ * frame. It may hang over any edge.
+ */
+struct nw_spifb_cursor {
+	const u32 *argb;
+	u32 width;
+	u32 height;
+	s32 x;
+	s32 y;
+};
+
+/* Layouts the YUV overlay takes, all 8 bits per sample */
+enum nw_spifb_yuv_format {
+	NW_SPIFB_YUV_NV12,	/* Y plane, then interleaved CbCr at half size */
+	NW_SPIFB_YUV_I420,	/* Y, Cb and Cr planes, chroma at half size */
+	NW_SPIFB_YUV_GREY,	/* Y only, full range (monochrome sensors) */
+};
+
+/* YCbCr -> RGB matrices, as the DRM plane colour properties name them */
+enum nw_spifb_yuv_matrix {
+	NW_SPIFB_BT601_LIMITED,
+	NW_SPIFB_BT601_FULL,
+	NW_SPIFB_BT709_LIMITED,
+	NW_SPIFB_BT709_FULL,
+};
+
+/*
+ * An opaque YUV image drawn over converted output: the src_w x src_h
+ * window of its planes at (src_x, src_y), scaled to width x height
+ * virtual pixels at (x, y). Unlike the cursor it must lie within the
+ * virtual frame.
+ */
+struct nw_spifb_overlay {
+	const u8 *plane[3];
+	u32 pitch[3];
+	enum nw_spifb_yuv_format format;
+	enum nw_spifb_yuv_matrix matrix;
+	u32 src_x;
+	u32 src_y;
+	u32 src_w;
+	u32 src_h;
+	u32 x;
+	u32 y;
+	u32 width;
+	u32 height;
+};
+
+#define NW_SPIFB_COLOUR_LUT_LEN	256
+
+/*
+ * CRTC colour management, in the order DRM applies it: each channel
+ * through its degamma LUT, the 3x3 colour transform matrix, then each
+ * channel through its gamma LUT. LUT entries are 0..0xffff.
+ */
+struct nw_spifb_colour {
+	u16 degamma[3][NW_SPIFB_COLOUR_LUT_LEN];	/* R, G, B */
+	s32 ctm[9];		/* Row-major, signed 16.16 fixed point */
+	u16 gamma[3][NW_SPIFB_COLOUR_LUT_LEN];
+};
+
+/* Entries of a colour table: one per big-endian RGB565 value */
+#define NW_SPIFB_COLOUR_TABLE_LEN	65536
+
+struct nw_spifb_scaler {
+	u32 width;		/* Output (physical) size */
+	u32 height;
+	u32 vwidth;		/* Source (virtual) size */
+	u32 vheight;
+	enum nw_spifb_ratio ratio;
+	enum nw_spifb_filter filter;
+
+	/* Nearest: source column/row of each output pixel */
+	u16 *xmap;
+	u16 *ymap;
+
+	/* Bilinear: left/top source column/row, and right/bottom weight (0..256) */
+	u16 *xmap_f;
+	u16 *xfrac;
+	u16 *ymap_f;
+	u16 *yfrac;
+};
+
+/*
+ * Whether the kernels work on output pixel pairs, so scaled rectangles
+ * are widened to even columns
+ */
+static inline bool nw_spifb_scaler_pairs(const struct nw_spifb_scaler *sc)
+{
+	return sc->ratio == NW_SPIFB_RATIO_3_2 || sc->ratio == NW_SPIFB_RATIO_1_2;
+}
+
+/*
+ * Whether an RGB565 framebuffer of @fb_width x @fb_height with @pitch
+ * bytes per row is the output as it is, so zero-copy can send it: the
+ * mode must be the panel size too. A panel-sized framebuffer in a
+ * smaller mode still has to be scaled (only its top left is shown).
+ */
+static inline bool nw_spifb_scaler_passthrough(const struct nw_spifb_scaler *sc,
+					       u32 fb_width, u32 fb_height,
+					       u32 pitch)
+{
+	return sc->vwidth == sc->width && sc->vheight == sc->height &&
+	       fb_width == sc->width && fb_height == sc->height &&
+	       pitch == sc->width * 2;
+}
+
+/* Number of u16 table entries nw_spifb_scaler_init() carves up */
+static inline size_t nw_spifb_scaler_table_len(u32 width, u32 height)
+{
+	return 3 * (width + height);
+}
+
+/* Bytes of per-caller scratch nw_spifb_scale_rows() needs */
+static inline size_t nw_spifb_scratch_size(u32 vwidth)
+{
+	return 2 * vwidth * 4;	/* Two source rows expanded to XRGB8888 */
+}
+
+void nw_spifb_scaler_init(struct nw_spifb_scaler *sc, u16 *tables,
+			  u32 width, u32 height, u32 vwidth, u32 vheight);
+
+void nw_spifb_palette_set(struct nw_spifb_palette *pal, u32 index,
+			  u32 r, u32 g, u32 b);
+void nw_spifb_palette_rgb332(struct nw_spifb_palette *pal);
+void nw_spifb_palette_grey(struct nw_spifb_palette *pal);
+
+void nw_spifb_scaler_span(u32 s0, u32 s1, u32 vn, u32 n, u32 *d0, u32 *d1);
+
+void nw_spifb_scale_rect(const struct nw_spifb_scaler *sc,
+			 const struct nw_spifb_src *src, u16 *dst,
+			 u32 x0, u32 y0, u32 x1, u32 y1, void *scratch);
+void nw_spifb_scale_rows(const struct nw_spifb_scaler *sc,
+			 const struct nw_spifb_src *src, u16 *dst,
+			 u32 y0, u32 y1, void *scratch);
+
+void nw_spifb_colour_identity(struct nw_spifb_colour *c);
+bool nw_spifb_colour_table(u16 *table, const struct nw_spifb_colour *c);
+void nw_spifb_colour_rect(const struct nw_spifb_scaler *sc, const u16 *table,
+			  u16 *dst, u32 x0, u32 y0, u32 x1, u32 y1);
+
+void nw_spifb_blend_cursor(const struct nw_spifb_scaler *sc,
+			   const struct nw_spifb_cursor *cur, u16 *dst,
+			   u32 x0, u32 y0, u32 x1, u32 y1);
+
+bool nw_spifb_overlay_span(const struct nw_spifb_scaler *sc,
+			   const struct nw_spifb_overlay *ov,
+			   u32 *x0, u32 *y0, u32 *x1, u32 *y1);
+void nw_spifb_draw_overlay(const struct nw_spifb_scaler *sc,
+			   const struct nw_spifb_overlay *ov, u16 *dst,
+			   u32 x0, u32 y0, u32 x1, u32 y1);
+
+/*
+ * Rounded divide by 3 for sums of up to 3 * 255, as used by the 3:2 box
+ * filter. Scalar and NEON kernels both use exactly this, so their output
+ * is bit-identical.
+ */
+static inline u32 nw_spifb_div3(u32 t)
+{
+	return (t * 21846 + 32768) >> 16;
+}
+
+#ifdef NW_SPIFB_HAVE_NEON
+/*
+ * NEON kernels (drm-spifb-neon.c). Each handles as many whole vector
+ * iterations as fit in @w and returns the number of output pixels it
+ * wrote; the caller finishes the tail with the scalar kernel. They must
+ * be called between kernel_neon_begin() and kernel_neon_end().
+ */
+u32 nw_spifb_neon_box_2_1(u16 *dst, const u8 *r0, const u8 *r1, u32 w);
+u32 nw_spifb_neon_box_3_2(u16 *dst, const u8 *heavy, const u8 *light, u32 w);
+u32 nw_spifb_neon_expand_rgb565(u8 *dst, const u16 *src, u32 n);
+#endif
+
+#endif /* __DRM_SPIFB_PIXEL_H__ */
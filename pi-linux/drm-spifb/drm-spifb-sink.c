@@ -0,0 +1,431 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Virtual SPI sink for drm-spifb
+ *
+ * A dummy SPI controller with a drm-spifb device on it, so the whole
+ * driver (atomic commits, conversion, wire encoding, frame pacing) runs
+ * on any Linux box, without a Pi or a calculator. Pair it with a
+ * compositor or a KMS test tool on the card it creates.
+ *
+ * Each message is held for as long as the bcm2835 would need to send
+ * it: a fixed setup cost (CS, FIFO and DMA setup) plus its bits at the
+ * simulated clock. An hrtimer then completes it, where the DMA
+ * callback would, so the driver's pacing, vblank and histograms see
+ * bus timings like the real ones.
+ *
+ * Every CS assertion is also recorded into a ring buffer which debugfs
+ * 'capture' drains in the spifb-tools capture format (u32 little-endian
+ * length, then the bytes), so spifb-emu and spifb-codec read it as is:
+ *
+ *   modprobe drm-spifb-sink partial=1
+ *   cat /sys/kernel/debug/drm-spifb-sink/capture > wire.bin
+ *   spifb-emu -v wire.bin
+ *
+ * A record that does not fit in the ring is dropped whole and counted
+ * in debugfs 'stats', so a capture is always a sequence of complete
+ * records, with gaps at worst.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/kfifo.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/spi/spi.h>
+#include <linux/string.h>
+
+#include <asm/byteorder.h>
+
+#define DRIVER_NAME	"drm-spifb-sink"
+
+/* Record length prefix, as in a capture file */
+#define REC_HDR_LEN	sizeof(__le32)
+
+/* partial-update, wire-depth, vwidth, vheight and the terminator */
+#define MAX_PROPS	5
+
+/* What the bcm2835 makes of the overlay's 70 MHz: 250 MHz / 4 */
+static unsigned int speed_hz = 62500000;
+module_param(speed_hz, uint, 0444);
+MODULE_PARM_DESC(speed_hz, "Simulated SPI clock in Hz (default: 62500000)");
+
+/*
+ * Fixed cost of one message on the bcm2835, as drm-spifb paces its
+ * vblank with (SPI_XFER_OVERHEAD_NS). Can be changed at any time.
+ */
+static unsigned int setup_us = 2400;
+module_param(setup_us, uint, 0644);
+MODULE_PARM_DESC(setup_us, "Simulated CS, FIFO and DMA setup per message in us (default: 2400)");
+
+/* Rounded up to a power of two; 0 only simulates the bus */
+static unsigned int ring_kb = 4096;
+module_param(ring_kb, uint, 0444);
+MODULE_PARM_DESC(ring_kb, "Capture ring size in KiB, 0 = no capture (default: 4096)");
+
+/* The device's DT properties, as the overlay parameters would set them */
+static bool partial;
+module_param(partial, bool, 0444);
+MODULE_PARM_DESC(partial, "Give the device partial-update, for the v2 wire format (default: false)");
+
+static unsigned int depth = 16;
+module_param(depth, uint, 0444);
+MODULE_PARM_DESC(depth, "Give the device this wire-depth, 8 needs partial (default: 16)");
+
+static unsigned int vwidth;
+module_param(vwidth, uint, 0444);
+MODULE_PARM_DESC(vwidth, "Give the device this vwidth (default: 0 = the driver's)");
+
+static unsigned int vheight;
+module_param(vheight, uint, 0444);
+MODULE_PARM_DESC(vheight, "Give the device this vheight (default: 0 = the driver's)");
+
+struct nw_spifb_sink {
+	struct spi_controller *ctlr;
+	struct hrtimer done_timer;	/* Completes the message on the bus */
+
+	/* Capture: one record per CS assertion, NULL @rec if disabled */
+	struct kfifo ring;
+	struct mutex read_lock;		/* One reader drains at a time */
+	u8 *rec;			/* Length prefix + the open assertion */
+	size_t rec_len;			/* Bytes after the prefix so far */
+	size_t rec_max;			/* Largest record the ring can hold */
+	bool rec_over;			/* The open assertion outgrew @rec */
+
+	struct property_entry props[MAX_PROPS];
+	struct software_node node;
+	struct dentry *debugfs;
+
+	/* Counters, reported in debugfs 'stats' */
+	u64 messages;
+	u64 transfers;
+	u64 bytes;
+	u64 bus_ns;			/* Simulated time on the bus */
+	u64 records;
+	u64 dropped;
+};
+
+/* Append what one transfer clocked out to the open assertion */
+static void nw_spifb_sink_record(struct nw_spifb_sink *sink,
+				 const void *buf, size_t len)
+{
+	u8 *dst;
+
+	if (!sink->rec || sink->rec_over)
+		return;
+
+	if (len > sink->rec_max - sink->rec_len) {
+		sink->rec_over = true;
+		return;
+	}
+
+	/* Receive-only transfers clock out zeros */
+	dst = sink->rec + REC_HDR_LEN + sink->rec_len;
+	if (buf)
+		memcpy(dst, buf, len);
+	else
+		memset(dst, 0, len);
+	sink->rec_len += len;
+}
+
+/*
+ * CS deasserted: push the assertion into the ring as one record. A
+ * single kfifo_in() publishes prefix and bytes together, so a reader
+ * never sees half a record.
+ */
+static void nw_spifb_sink_end_record(struct nw_spifb_sink *sink)
+{
+	size_t len = REC_HDR_LEN + sink->rec_len;
+
+	if (!sink->rec)
+		return;
+
+	if (sink->rec_over || kfifo_avail(&sink->ring) < len) {
+		WRITE_ONCE(sink->dropped, sink->dropped + 1);
+	} else {
+		*(__le32 *)sink->rec = cpu_to_le32(sink->rec_len);
+		kfifo_in(&sink->ring, sink->rec, len);
+		WRITE_ONCE(sink->records, sink->records + 1);
+	}
+
+	sink->rec_len = 0;
+	sink->rec_over = false;
+}
+
+static int nw_spifb_sink_transfer_one_message(struct spi_controller *ctlr,
+					      struct spi_message *msg)
+{
+	struct nw_spifb_sink *sink = spi_controller_get_devdata(ctlr);
+	u64 ns = (u64)READ_ONCE(setup_us) * NSEC_PER_USEC;
+	struct spi_transfer *xfer;
+
+	list_for_each_entry(xfer, &msg->transfers, transfer_list) {
+		u32 hz = xfer->speed_hz ?: ctlr->max_speed_hz;
+		bool last = list_is_last(&xfer->transfer_list, &msg->transfers);
+
+		nw_spifb_sink_record(sink, xfer->tx_buf, xfer->len);
+
+		/* Nothing drives MISO */
+		if (xfer->rx_buf)
+			memset(xfer->rx_buf, 0, xfer->len);
+
+		ns += div_u64((u64)xfer->len * 8 * NSEC_PER_SEC, hz);
+		msg->actual_length += xfer->len;
+		WRITE_ONCE(sink->transfers, sink->transfers + 1);
+		WRITE_ONCE(sink->bytes, sink->bytes + xfer->len);
+
+		/*
+		 * cs_change toggles CS after a transfer in the middle, and
+		 * keeps it asserted into the next message after the last
+		 * one (drm-spifb's streamed frames).
+		 */
+		if (xfer->cs_change != last)
+			nw_spifb_sink_end_record(sink);
+	}
+
+	WRITE_ONCE(sink->messages, sink->messages + 1);
+	WRITE_ONCE(sink->bus_ns, sink->bus_ns + ns);
+
+	msg->status = 0;
+	hrtimer_start(&sink->done_timer, ns_to_ktime(ns), HRTIMER_MODE_REL_SOFT);
+
+	return 0;
+}
+
+/* The message is off the simulated bus: complete it, as DMA would */
+static enum hrtimer_restart nw_spifb_sink_done(struct hrtimer *timer)
+{
+	struct nw_spifb_sink *sink = container_of(timer, struct nw_spifb_sink,
+						  done_timer);
+
+	spi_finalize_current_message(sink->ctlr);
+
+	return HRTIMER_NORESTART;
+}
+
+/* --- debugfs --- */
+
+static int nw_spifb_sink_stats_show(struct seq_file *m, void *data)
+{
+	struct nw_spifb_sink *sink = m->private;
+
+	seq_printf(m, "messages: %llu\n", READ_ONCE(sink->messages));
+	seq_printf(m, "transfers: %llu\n", READ_ONCE(sink->transfers));
+	seq_printf(m, "bytes: %llu\n", READ_ONCE(sink->bytes));
+	seq_printf(m, "bus_us: %llu\n",
+		   div_u64(READ_ONCE(sink->bus_ns), NSEC_PER_USEC));
+	seq_printf(m, "speed_hz: %u\n", sink->ctlr->max_speed_hz);
+	seq_printf(m, "setup_us: %u\n", READ_ONCE(setup_us));
+	if (!sink->rec)
+		return 0;
+
+	seq_printf(m, "records: %llu\n", READ_ONCE(sink->records));
+	seq_printf(m, "dropped: %llu\n", READ_ONCE(sink->dropped));
+	seq_printf(m, "ring_used: %u\n", kfifo_len(&sink->ring));
+	seq_printf(m, "ring_size: %u\n", kfifo_size(&sink->ring));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nw_spifb_sink_stats);
+
+/*
+ * debugfs 'capture': drains the ring. Reads return what has been
+ * recorded so far and 0 once it is empty, so 'cat' ends.
+ */
+static ssize_t nw_spifb_sink_capture_read(struct file *file, char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	struct nw_spifb_sink *sink = file->private_data;
+	unsigned int copied;
+	int ret;
+
+	if (mutex_lock_interruptible(&sink->read_lock))
+		return -ERESTARTSYS;
+	ret = kfifo_to_user(&sink->ring, buf, count, &copied);
+	mutex_unlock(&sink->read_lock);
+
+	return ret ? ret : copied;
+}
+
+static const struct file_operations nw_spifb_sink_capture_fops = {
+	.owner		= THIS_MODULE,
+	.open		= simple_open,
+	.read		= nw_spifb_sink_capture_read,
+};
+
+/* --- Platform probe --- */
+
+static void nw_spifb_sink_kvfree(void *ptr)
+{
+	kvfree(ptr);
+}
+
+static void nw_spifb_sink_cancel(void *data)
+{
+	struct nw_spifb_sink *sink = data;
+
+	hrtimer_cancel(&sink->done_timer);
+}
+
+static void nw_spifb_sink_debugfs_remove(void *data)
+{
+	struct nw_spifb_sink *sink = data;
+
+	debugfs_remove_recursive(sink->debugfs);
+}
+
+static int nw_spifb_sink_init_ring(struct device *dev,
+				   struct nw_spifb_sink *sink)
+{
+	size_t size = roundup_pow_of_two((size_t)ring_kb * SZ_1K);
+	void *ring;
+	int ret;
+
+	ring = kvmalloc(size, GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+	ret = devm_add_action_or_reset(dev, nw_spifb_sink_kvfree, ring);
+	if (ret)
+		return ret;
+
+	ret = kfifo_init(&sink->ring, ring, size);
+	if (ret)
+		return ret;
+
+	/* A whole record has to fit in the ring, prefix included */
+	sink->rec_max = size - REC_HDR_LEN;
+	sink->rec = kvmalloc(size, GFP_KERNEL);
+	if (!sink->rec)
+		return -ENOMEM;
+
+	return devm_add_action_or_reset(dev, nw_spifb_sink_kvfree, sink->rec);
+}
+
+/* The device's properties, as the overlay would put them in DT */
+static void nw_spifb_sink_init_props(struct nw_spifb_sink *sink)
+{
+	struct property_entry *prop = sink->props;
+
+	if (partial)
+		*prop++ = PROPERTY_ENTRY_BOOL("partial-update");
+	if (depth != 16)
+		*prop++ = PROPERTY_ENTRY_U32("wire-depth", depth);
+	if (vwidth)
+		*prop++ = PROPERTY_ENTRY_U32("vwidth", vwidth);
+	if (vheight)
+		*prop++ = PROPERTY_ENTRY_U32("vheight", vheight);
+
+	sink->node.properties = sink->props;
+}
+
+static int nw_spifb_sink_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct spi_board_info info = {
+		.modalias	= "spifb",
+		.max_speed_hz	= speed_hz,
+	};
+	struct spi_controller *ctlr;
+	struct nw_spifb_sink *sink;
+	int ret;
+
+	if (!speed_hz)
+		return -EINVAL;
+
+	ctlr = devm_spi_alloc_host(dev, sizeof(*sink));
+	if (!ctlr)
+		return -ENOMEM;
+
+	sink = spi_controller_get_devdata(ctlr);
+	sink->ctlr = ctlr;
+	mutex_init(&sink->read_lock);
+
+	if (ring_kb) {
+		ret = nw_spifb_sink_init_ring(dev, sink);
+		if (ret)
+			return ret;
+	}
+
+	hrtimer_init(&sink->done_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_SOFT);
+	sink->done_timer.function = nw_spifb_sink_done;
+	ret = devm_add_action_or_reset(dev, nw_spifb_sink_cancel, sink);
+	if (ret)
+		return ret;
+
+	ctlr->bus_num = -1;
+	ctlr->num_chipselect = 1;
+	ctlr->mode_bits = SPI_CPOL | SPI_CPHA;
+	ctlr->bits_per_word_mask = SPI_BPW_RANGE_MASK(8, 16);
+	ctlr->max_speed_hz = speed_hz;
+	ctlr->transfer_one_message = nw_spifb_sink_transfer_one_message;
+
+	ret = devm_spi_register_controller(dev, ctlr);
+	if (ret)
+		return ret;
+
+	/* Unregistered along with the controller */
+	nw_spifb_sink_init_props(sink);
+	info.swnode = &sink->node;
+	if (!spi_new_device(ctlr, &info))
+		return -ENODEV;
+
+	sink->debugfs = debugfs_create_dir(DRIVER_NAME, NULL);
+	debugfs_create_file("stats", 0444, sink->debugfs, sink,
+			    &nw_spifb_sink_stats_fops);
+	if (sink->rec)
+		debugfs_create_file("capture", 0400, sink->debugfs, sink,
+				    &nw_spifb_sink_capture_fops);
+
+	dev_info(dev, "simulating %u Hz + %u us per message, %s\n", speed_hz,
+		 setup_us, sink->rec ? "capturing" : "not capturing");
+
+	return devm_add_action_or_reset(dev, nw_spifb_sink_debugfs_remove, sink);
+}
+
+static struct platform_driver nw_spifb_sink_driver = {
+	.driver = {
+		.name	= DRIVER_NAME,
+	},
+	.probe	= nw_spifb_sink_probe,
+};
+
+static struct platform_device *nw_spifb_sink_pdev;
+
+static int __init nw_spifb_sink_init(void)
+{
+	int ret;
+
+	ret = platform_driver_register(&nw_spifb_sink_driver);
+	if (ret)
+		return ret;
+
+	nw_spifb_sink_pdev = platform_device_register_simple(DRIVER_NAME,
+							     PLATFORM_DEVID_NONE,
+							     NULL, 0);
+	if (IS_ERR(nw_spifb_sink_pdev)) {
+		platform_driver_unregister(&nw_spifb_sink_driver);
+		return PTR_ERR(nw_spifb_sink_pdev);
+	}
+
+	return 0;
+}
+module_init(nw_spifb_sink_init);
+
+static void __exit nw_spifb_sink_exit(void)
+{
+	platform_device_unregister(nw_spifb_sink_pdev);
+	platform_driver_unregister(&nw_spifb_sink_driver);
+}
+module_exit(nw_spifb_sink_exit);
+
+MODULE_DESCRIPTION("Virtual SPI sink for drm-spifb");
+MODULE_AUTHOR("Martin");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Rolling per-phase frame timing for drm-spifb (see drm-spifb-stats.h)
+ */
+
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/sort.h>
+
+#include "drm-spifb-stats.h"
+
+const char *const nw_spifb_phase_names[NW_SPIFB_PHASES] = {
+	[NW_SPIFB_PHASE_QUEUE]		= "queue",
+	[NW_SPIFB_PHASE_PREPARE]	= "prepare",
+	[NW_SPIFB_PHASE_ENCODE]		= "encode",
+	[NW_SPIFB_PHASE_WAIT]		= "wait",
+	[NW_SPIFB_PHASE_SPI]		= "spi",
+	[NW_SPIFB_PHASE_LATENCY]	= "latency",
+};
+
+void nw_spifb_hist_add(struct nw_spifb_hist *hist, u64 ns)
+{
+	/* Saturate rather than wrap: a stall of over an hour is still one */
+	hist->us[hist->next] = min_t(u64, div_u64(ns, 1000), U32_MAX);
+	hist->next = (hist->next + 1) % NW_SPIFB_HIST_LEN;
+	if (hist->len < NW_SPIFB_HIST_LEN)
+		hist->len++;
+}
+
+static int nw_spifb_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Smallest sample with at least @pct percent of all samples <= it */
+static u32 nw_spifb_hist_rank(const struct nw_spifb_hist *hist, u32 pct)
+{
+	return hist->us[DIV_ROUND_UP(hist->len * pct, 100) - 1];
+}
+
+void nw_spifb_hist_summarize(struct nw_spifb_hist *hist,
+			     struct nw_spifb_hist_summary *sum)
+{
+	sum->samples = hist->len;
+	if (!hist->len) {
+		sum->p50 = sum->p99 = sum->max = 0;
+		return;
+	}
+
+	sort(hist->us, hist->len, sizeof(hist->us[0]), nw_spifb_cmp_u32, NULL);
+
+	sum->p50 = nw_spifb_hist_rank(hist, 50);
+	sum->p99 = nw_spifb_hist_rank(hist, 99);
+	sum->max = hist->us[hist->len - 1];
+}
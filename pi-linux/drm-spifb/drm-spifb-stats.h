@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Rolling per-phase frame timing for drm-spifb
+ *
+ * Each phase keeps its last NW_SPIFB_HIST_LEN durations in a ring, so
+ * the percentiles in debugfs 'stats' describe the last few seconds of
+ * use rather than everything since the module was loaded.
+ *
+ * Shared with spifb-tools, so nothing in here may depend on DRM.
+ */
+
+#ifndef __DRM_SPIFB_STATS_H__
+#define __DRM_SPIFB_STATS_H__
+
+#include <linux/types.h>
+
+#define NW_SPIFB_HIST_LEN	256	/* ~5 s of frames at bus rate */
+
+enum nw_spifb_phase {
+	NW_SPIFB_PHASE_QUEUE,		/* Commit to worker pickup */
+	NW_SPIFB_PHASE_PREPARE,		/* Map, stage, scale/convert */
+	NW_SPIFB_PHASE_ENCODE,		/* v2 message encoding */
+	NW_SPIFB_PHASE_WAIT,		/* Waiting for the previous transfer */
+	NW_SPIFB_PHASE_SPI,		/* spi_async() to completion */
+	NW_SPIFB_PHASE_LATENCY,		/* Commit to frame on the LCD */
+	NW_SPIFB_PHASES,
+};
+
+extern const char *const nw_spifb_phase_names[NW_SPIFB_PHASES];
+
+struct nw_spifb_hist {
+	u32 us[NW_SPIFB_HIST_LEN];	/* Ring of durations in microseconds */
+	u32 next;			/* Slot the next sample goes to */
+	u32 len;			/* Samples held, up to NW_SPIFB_HIST_LEN */
+};
+
+struct nw_spifb_hist_summary {
+	u32 samples;
+	u32 p50, p99, max;		/* Microseconds, 0 without samples */
+};
+
+void nw_spifb_hist_add(struct nw_spifb_hist *hist, u64 ns);
+
+/*
+ * Percentiles (nearest rank) over the samples @hist holds. Sorts the
+ * ring in place, so pass a copy of a histogram that is still in use.
+ */
+void nw_spifb_hist_summarize(struct nw_spifb_hist *hist,
+			     struct nw_spifb_hist_summary *sum);
+
+#endif /* __DRM_SPIFB_STATS_H__ */
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Tracepoints for drm-spifb
+ *
+ * Every frame the worker picks up gets a sequence number, carried by
+ * all its events, so a trace shows each frame's prepare, wait and
+ * transfer as spans:
+ *
+ *   trace-cmd record -e drm_spifb
+ *
+ * The same durations feed the histograms in debugfs 'stats'.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM drm_spifb
+
+#if !defined(__DRM_SPIFB_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __DRM_SPIFB_TRACE_H__
+
+#include <linux/tracepoint.h>
+
+#include <drm/drm_rect.h>
+
+TRACE_EVENT(drm_spifb_queue,
+	TP_PROTO(const struct drm_rect *damage, bool dropped),
+	TP_ARGS(damage, dropped),
+	TP_STRUCT__entry(
+		__field(int, x1)
+		__field(int, y1)
+		__field(int, x2)
+		__field(int, y2)
+		__field(bool, dropped)
+	),
+	TP_fast_assign(
+		__entry->x1 = damage->x1;
+		__entry->y1 = damage->y1;
+		__entry->x2 = damage->x2;
+		__entry->y2 = damage->y2;
+		__entry->dropped = dropped;
+	),
+	TP_printk("damage=(%d,%d)-(%d,%d) dropped=%d", __entry->x1,
+		  __entry->y1, __entry->x2, __entry->y2, __entry->dropped)
+);
+
+DECLARE_EVENT_CLASS(drm_spifb_begin,
+	TP_PROTO(u64 seq),
+	TP_ARGS(seq),
+	TP_STRUCT__entry(
+		__field(u64, seq)
+	),
+	TP_fast_assign(
+		__entry->seq = seq;
+	),
+	TP_printk("seq=%llu", __entry->seq)
+);
+
+DECLARE_EVENT_CLASS(drm_spifb_end,
+	TP_PROTO(u64 seq, u64 ns),
+	TP_ARGS(seq, ns),
+	TP_STRUCT__entry(
+		__field(u64, seq)
+		__field(u64, ns)
+	),
+	TP_fast_assign(
+		__entry->seq = seq;
+		__entry->ns = ns;
+	),
+	TP_printk("seq=%llu ns=%llu", __entry->seq, __entry->ns)
+);
+
+DEFINE_EVENT(drm_spifb_begin, drm_spifb_prepare_begin,
+	TP_PROTO(u64 seq),
+	TP_ARGS(seq)
+);
+
+DEFINE_EVENT(drm_spifb_end, drm_spifb_prepare_end,
+	TP_PROTO(u64 seq, u64 ns),
+	TP_ARGS(seq, ns)
+);
+
+DEFINE_EVENT(drm_spifb_begin, drm_spifb_wait_begin,
+	TP_PROTO(u64 seq),
+	TP_ARGS(seq)
+);
+
+DEFINE_EVENT(drm_spifb_end, drm_spifb_wait_end,
+	TP_PROTO(u64 seq, u64 ns),
+	TP_ARGS(seq, ns)
+);
+
+/* Converted frame identical to the one on the LCD, not sent */
+DEFINE_EVENT(drm_spifb_begin, drm_spifb_skip,
+	TP_PROTO(u64 seq),
+	TP_ARGS(seq)
+);
+
+TRACE_EVENT(drm_spifb_submit,
+	TP_PROTO(u64 seq, const struct drm_rect *win, u32 encoding, u32 len),
+	TP_ARGS(seq, win, encoding, len),
+	TP_STRUCT__entry(
+		__field(u64, seq)
+		__field(int, x)
+		__field(int, y)
+		__field(int, w)
+		__field(int, h)
+		__field(u32, encoding)
+		__field(u32, len)
+	),
+	TP_fast_assign(
+		__entry->seq = seq;
+		__entry->x = win->x1;
+		__entry->y = win->y1;
+		__entry->w = drm_rect_width(win);
+		__entry->h = drm_rect_height(win);
+		__entry->encoding = encoding;
+		__entry->len = len;
+	),
+	TP_printk("seq=%llu window=%dx%d+%d+%d encoding=%u len=%u",
+		  __entry->seq, __entry->w, __entry->h, __entry->x,
+		  __entry->y, __entry->encoding, __entry->len)
+);
+
+TRACE_EVENT(drm_spifb_spi_complete,
+	TP_PROTO(u64 seq, int status, u64 ns),
+	TP_ARGS(seq, status, ns),
+	TP_STRUCT__entry(
+		__field(u64, seq)
+		__field(int, status)
+		__field(u64, ns)
+	),
+	TP_fast_assign(
+		__entry->seq = seq;
+		__entry->status = status;
+		__entry->ns = ns;
+	),
+	TP_printk("seq=%llu status=%d ns=%llu", __entry->seq,
+		  __entry->status, __entry->ns)
+);
+
+#endif /* __DRM_SPIFB_TRACE_H__ */
+
+/* This part must be outside the header guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE drm-spifb-trace
+#include <trace/define_trace.h>
@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * v2 wire format encoder for drm-spifb (see drm-spifb-wire.h)
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#include <asm/byteorder.h>
+
+#include "drm-spifb-wire.h"
+
+void nw_spifb_wire_hdr_init(struct nw_spifb_wire_hdr *hdr,
+			    enum nw_spifb_wire_encoding encoding,
+			    u32 x, u32 y, u32 w, u32 h, u32 len)
+{
+	hdr->magic = cpu_to_be16(NW_SPIFB_WIRE_MAGIC);
+	hdr->version = NW_SPIFB_WIRE_VERSION;
+	hdr->encoding = encoding;
+	hdr->x = cpu_to_be16(x);
+	hdr->y = cpu_to_be16(y);
+	hdr->w = cpu_to_be16(w);
+	hdr->h = cpu_to_be16(h);
+	hdr->len = cpu_to_be32(len);
+}
+
+/*
+ * Run-length encoder state. Values are pushed one at a time; equal
+ * values are counted and only turned into a repeat run once a different
+ * value arrives, shorter stretches are appended to the open literal.
+ */
+struct nw_spifb_rle {
+	u16 *out;		/* Next free word */
+	u16 *end;		/* Output beyond this is no smaller than raw */
+	u16 *lit;		/* Control word of the open literal, or NULL */
+	u32 lit_len;
+	u16 val;		/* Pending value... */
+	u32 count;		/* ...and how many times in a row */
+};
+
+static bool nw_spifb_rle_flush(struct nw_spifb_rle *r)
+{
+	u32 n;
+
+	/* A repeat costs two words, so it only wins from three pixels on */
+	if (r->count >= 3) {
+		for (; r->count; r->count -= n) {
+			n = min_t(u32, r->count, NW_SPIFB_RLE_MAX);
+			if (r->end - r->out < 2)
+				return false;
+			*r->out++ = cpu_to_be16(NW_SPIFB_RLE_REPEAT | (n - 1));
+			*r->out++ = r->val;
+		}
+		r->lit = NULL;
+		return true;
+	}
+
+	for (; r->count; r->count--) {
+		if (!r->lit || r->lit_len == NW_SPIFB_RLE_MAX) {
+			if (r->out == r->end)
+				return false;
+			r->lit = r->out++;
+			r->lit_len = 0;
+		}
+		if (r->out == r->end)
+			return false;
+		*r->out++ = r->val;
+		*r->lit = cpu_to_be16(r->lit_len++);
+	}
+	return true;
+}
+
+static inline bool nw_spifb_rle_push(struct nw_spifb_rle *r, u16 val)
+{
+	if (r->count && val == r->val) {
+		r->count++;
+		return true;
+	}
+	if (r->count && !nw_spifb_rle_flush(r))
+		return false;
+
+	r->val = val;
+	r->count = 1;
+	return true;
+}
+
+/*
+ * RLE-encode the window into @dst, XORing with @prev if given. Its rows
+ * are @stride pixels apart in both. Returns the payload length, or 0 if
+ * it would not be smaller than @limit.
+ */
+static size_t nw_spifb_wire_rle(u16 *dst, size_t limit, const u16 *frame,
+				const u16 *prev, u32 stride, u32 w, u32 h)
+{
+	struct nw_spifb_rle r = {
+		.out = dst,
+		.end = dst + limit / 2 - 1,
+	};
+	u32 offset = 0;
+	u32 row, col;
+
+	for (row = 0; row < h; row++, offset += stride) {
+		const u16 *src = frame + offset;
+
+		if (prev) {
+			const u16 *old = prev + offset;
+
+			for (col = 0; col < w; col++)
+				if (!nw_spifb_rle_push(&r, src[col] ^ old[col]))
+					return 0;
+		} else {
+			for (col = 0; col < w; col++)
+				if (!nw_spifb_rle_push(&r, src[col]))
+					return 0;
+		}
+	}
+
+	if (!nw_spifb_rle_flush(&r))
+		return 0;
+
+	return (r.out - dst) * 2;
+}
+
+size_t nw_spifb_wire_encode(void *out, const u16 *frame, const u16 *prev,
+			    u32 width, u32 x, u32 y, u32 w, u32 h,
+			    enum nw_spifb_wire_encoding encoding, bool field)
+{
+	struct nw_spifb_wire_hdr *hdr = out;
+	u16 *dst = (u16 *)(hdr + 1);
+	u32 offset = y * width + x;
+	u32 stride = field ? 2 * width : width;
+	const u16 *src = frame + offset;
+	size_t raw = w * h * 2, len = 0;
+	u32 row;
+
+	if (encoding == NW_SPIFB_ENC_XOR_RLE && !prev)
+		encoding = NW_SPIFB_ENC_RLE;
+
+	if (encoding != NW_SPIFB_ENC_RAW) {
+		len = nw_spifb_wire_rle(dst, raw, src,
+					encoding == NW_SPIFB_ENC_XOR_RLE ?
+					prev + offset : NULL, stride, w, h);
+		if (!len)
+			encoding = NW_SPIFB_ENC_RAW;
+	}
+
+	if (encoding == NW_SPIFB_ENC_RAW) {
+		len = raw;
+
+		/* Full-width windows are contiguous in the frame already */
+		if (w == stride) {
+			memcpy(dst, src, raw);
+		} else {
+			for (row = 0; row < h; row++, dst += w, src += stride)
+				memcpy(dst, src, w * 2);
+		}
+	}
+
+	nw_spifb_wire_hdr_init(hdr, encoding, x, y, w, h, len);
+	if (field)
+		hdr->encoding |= NW_SPIFB_WIRE_FIELD;
+
+	return sizeof(*hdr) + len;
+}
+
+/* 4x4 Bayer matrix: the fraction of a step past which a pixel rounds up */
+static const u8 nw_spifb_bayer[4][4] = {
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
+
+/*
+ * RGB332 levels of one RGB565 channel: for each of its values, the
+ * wire level at or below it and how far it is towards the next one, in
+ * sixteenths. Levels are where the slave puts them, not evenly spaced,
+ * so colours RGB332 can show come through unchanged.
+ */
+struct nw_spifb_levels {
+	u8 base[64];
+	u8 frac[64];
+};
+
+/* Widen @v from @from to @to bits by repeating its top bits, as the slave */
+static u32 nw_spifb_widen(u32 v, int from, int to)
+{
+	u32 out = 0;
+	int shift;
+
+	for (shift = to - from; shift > -from; shift -= from)
+		out |= shift >= 0 ? v << shift : v >> -shift;
+	return out;
+}
+
+static void nw_spifb_levels_init(struct nw_spifb_levels *l, int bits,
+				 int wire_bits)
+{
+	u32 top = (1 << wire_bits) - 1;
+	u32 v, i = 0, lo, hi;
+
+	for (v = 0; v < 1U << bits; v++) {
+		while (i < top && nw_spifb_widen(i + 1, wire_bits, bits) <= v)
+			i++;
+		l->base[v] = i;
+		l->frac[v] = 0;
+		if (i == top)
+			continue;
+
+		lo = nw_spifb_widen(i, wire_bits, bits);
+		hi = nw_spifb_widen(i + 1, wire_bits, bits);
+		l->frac[v] = (v - lo) * 16 / (hi - lo);
+	}
+}
+
+static inline u32 nw_spifb_level(const struct nw_spifb_levels *l, u32 v,
+				 u32 t)
+{
+	return l->base[v] + (l->frac[v] > t);
+}
+
+size_t nw_spifb_wire_encode_rgb332(void *out, const u16 *frame, u32 width,
+				   u32 x, u32 y, u32 w, u32 h, bool field,
+				   bool dither)
+{
+	struct nw_spifb_wire_hdr *hdr = out;
+	struct nw_spifb_levels r, g, b;
+	u8 *dst = (u8 *)(hdr + 1);
+	u32 step = field ? 2 : 1;
+	const u16 *src = frame + y * width + x;
+	u32 row, col;
+
+	nw_spifb_levels_init(&r, 5, 3);
+	nw_spifb_levels_init(&g, 6, 3);
+	nw_spifb_levels_init(&b, 5, 2);
+
+	for (row = 0; row < h; row++, src += step * width) {
+		const u8 *bayer = nw_spifb_bayer[(y + row * step) & 3];
+
+		for (col = 0; col < w; col++) {
+			u16 p = be16_to_cpu(src[col]);
+			/* Undithered: round to the nearest level */
+			u32 t = dither ? bayer[(x + col) & 3] : 7;
+
+			*dst++ = nw_spifb_level(&r, p >> 11, t) << 5 |
+				 nw_spifb_level(&g, (p >> 5) & 0x3f, t) << 2 |
+				 nw_spifb_level(&b, p & 0x1f, t);
+		}
+	}
+
+	nw_spifb_wire_hdr_init(hdr, NW_SPIFB_ENC_RGB332, x, y, w, h, w * h);
+	if (field)
+		hdr->encoding |= NW_SPIFB_WIRE_FIELD;
+
+	return sizeof(*hdr) + w * h;
+}
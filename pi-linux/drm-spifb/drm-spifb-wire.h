@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * SPI wire format between drm-spifb and the calculator's STM32
+ *
+ * v1 (default): every CS assertion carries one complete width x height
+ * frame of big-endian RGB565 and nothing else.
+ *
+ * v2 ('partial-update' DT property): every CS assertion starts with a
+ * struct nw_spifb_wire_hdr, followed by @len payload bytes that fill
+ * the LCD window (@x, @y, @w, @h) in row-major order. Header fields are
+ * big-endian, like the pixels. The slave can tell the two apart by the
+ * magic in the first 16 bytes.
+ *
+ * v2 payloads may be run-length encoded. The window's pixels are taken
+ * as one row-major stream and cut into runs, each starting with a
+ * big-endian control word:
+ *
+ *   0nnnnnnn nnnnnnnn  literal: n + 1 pixels follow
+ *   1nnnnnnn nnnnnnnn  repeat: one pixel follows, written n + 1 times
+ *
+ * With XOR delta the decoded values are XORed into what the LCD shows
+ * instead of replacing it, so unchanged areas become long zero runs.
+ * The encoder only picks an encoding when it is smaller than raw.
+ *
+ * Little-endian raw is raw with each pixel's two bytes swapped: native
+ * RGB565 as the Pi's CPU stores it. The driver sends 1:1 RGB565
+ * framebuffers this way straight from the GEM buffer ('zerocopy'), as
+ * whole rows after a separately transferred header.
+ *
+ * A field message ('field' param) has NW_SPIFB_WIRE_FIELD ORed into its
+ * encoding: its window's h rows are every other LCD row, y, y + 2, ...,
+ * y + 2 * (h - 1), and the payload carries only those, encoded as
+ * usual. Each field halves the bytes of a window update. Slaves that
+ * predate it reject it as an unknown encoding.
+ *
+ * RGB332 payloads ('wire-depth = <8>' DT property) carry one RRRGGGBB
+ * byte per pixel, half of raw. The slave widens each to RGB565 by
+ * repeating the channel's top bits, see nw_spifb_rgb332_to_rgb565().
+ * The encoder reduces the frame with an ordered dither, so flat
+ * gradients keep their average colour rather than banding.
+ *
+ * Shared with the host-side slave emulator in spifb-tools, so nothing
+ * in here may depend on DRM.
+ */
+
+#ifndef __DRM_SPIFB_WIRE_H__
+#define __DRM_SPIFB_WIRE_H__
+
+#include <linux/types.h>
+
+#define NW_SPIFB_WIRE_MAGIC	0x4e57	/* "NW" */
+#define NW_SPIFB_WIRE_VERSION	2
+
+enum nw_spifb_wire_encoding {
+	NW_SPIFB_ENC_RAW,	/* w * h big-endian RGB565 pixels */
+	NW_SPIFB_ENC_RLE,	/* Runs of pixels */
+	NW_SPIFB_ENC_XOR_RLE,	/* Runs of pixel XOR previous LCD contents */
+	NW_SPIFB_ENC_RAW_LE,	/* w * h little-endian RGB565 pixels */
+	NW_SPIFB_ENC_RGB332,	/* w * h RGB332 bytes */
+	NW_SPIFB_ENCODINGS,
+};
+
+#define NW_SPIFB_WIRE_FIELD	0x80	/* Encoding flag: alternate rows */
+
+#define NW_SPIFB_RLE_REPEAT	0x8000
+#define NW_SPIFB_RLE_MAX	0x8000	/* Longest run per control word */
+
+struct nw_spifb_wire_hdr {
+	__be16 magic;
+	u8 version;
+	u8 encoding;		/* enum nw_spifb_wire_encoding, NW_SPIFB_WIRE_FIELD */
+	__be16 x;
+	__be16 y;
+	__be16 w;
+	__be16 h;
+	__be32 len;		/* Payload bytes following the header */
+};
+
+/* Largest v2 message for a width x height LCD */
+static inline size_t nw_spifb_wire_max_len(u32 width, u32 height)
+{
+	return sizeof(struct nw_spifb_wire_hdr) + width * height * 2;
+}
+
+/* What the slave writes to the LCD for an RGB332 byte, in CPU order */
+static inline u16 nw_spifb_rgb332_to_rgb565(u8 c)
+{
+	u16 r = c >> 5, g = (c >> 2) & 7, b = c & 3;
+
+	return (r << 2 | r >> 1) << 11 | (g << 3 | g) << 5 |
+	       (b << 3 | b << 1 | b >> 1);
+}
+
+void nw_spifb_wire_hdr_init(struct nw_spifb_wire_hdr *hdr,
+			    enum nw_spifb_wire_encoding encoding,
+			    u32 x, u32 y, u32 w, u32 h, u32 len);
+
+/*
+ * Encode window (@x, @y, @w, @h) of @frame, a big-endian RGB565 frame
+ * @width pixels wide, as a v2 message into @out, trying @encoding first
+ * and falling back to raw if that is not smaller. XOR delta needs
+ * @prev, the frame the LCD currently shows; without it plain RLE is
+ * tried instead. Little-endian raw is not produced here. With @field
+ * the window's rows are every other row from @y, sent as a field
+ * message. Returns the message length; @out must hold
+ * nw_spifb_wire_max_len() bytes.
+ */
+size_t nw_spifb_wire_encode(void *out, const u16 *frame, const u16 *prev,
+			    u32 width, u32 x, u32 y, u32 w, u32 h,
+			    enum nw_spifb_wire_encoding encoding, bool field);
+
+/*
+ * Same for an RGB332 message: each pixel of the window is reduced to
+ * 8 bits, with a 4x4 ordered dither anchored to the LCD if @dither.
+ */
+size_t nw_spifb_wire_encode_rgb332(void *out, const u16 *frame, u32 width,
+				   u32 x, u32 y, u32 w, u32 h, bool field,
+				   bool dither);
+
+#endif /* __DRM_SPIFB_WIRE_H__ */
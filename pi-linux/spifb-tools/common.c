@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Shared helpers for the drm-spifb userspace tools
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+const struct spifb_mode spifb_modes[] = {
+	{ 160, 120 },	/* 1:2, upscaled */
+	{ 240, 180 },	/* 3:4, upscaled through the tables */
+	{ 320, 240 },	/* 1:1 */
+	{ 400, 300 },	/* 5:4, generic table path */
+	{ 480, 360 },	/* 3:2 */
+	{ 640, 480 },	/* 2:1 */
+};
+const size_t spifb_num_modes = sizeof(spifb_modes) / sizeof(spifb_modes[0]);
+
+const char *const spifb_pattern_names[] = {
+	"gradient",	/* Smooth ramps: exposes rounding/banding errors */
+	"checker",	/* 1px checkerboard: worst case for any filter */
+	"lines",	/* 1px coloured rows and columns */
+	"text",		/* Sparse 1px strokes on white, like terminal text */
+	"noise",	/* Pseudo-random pixels */
+};
+const size_t spifb_num_patterns =
+	sizeof(spifb_pattern_names) / sizeof(spifb_pattern_names[0]);
+
+const char *spifb_format_name(enum nw_spifb_src_format format)
+{
+	switch (format) {
+	case NW_SPIFB_SRC_XRGB8888:
+		return "xrgb8888";
+	case NW_SPIFB_SRC_RGB565:
+		return "rgb565";
+	case NW_SPIFB_SRC_C8:
+		return "c8";
+	}
+	return "?";
+}
+
+const char *spifb_filter_name(enum nw_spifb_filter filter)
+{
+	return filter == NW_SPIFB_FILTER_BOX ? "box" : "nearest";
+}
+
+uint32_t spifb_format_cpp(enum nw_spifb_src_format format)
+{
+	switch (format) {
+	case NW_SPIFB_SRC_RGB565:
+		return 2;
+	case NW_SPIFB_SRC_C8:
+		return 1;
+	default:
+		return 4;
+	}
+}
+
+const struct nw_spifb_palette *spifb_format_palette(enum nw_spifb_src_format format)
+{
+	static struct nw_spifb_palette rgb332;
+	static int init;
+
+	if (format != NW_SPIFB_SRC_C8)
+		return NULL;
+	if (!init) {
+		nw_spifb_palette_rgb332(&rgb332);
+		init = 1;
+	}
+	return &rgb332;
+}
+
+void spifb_pattern(uint32_t *img, uint32_t w, uint32_t h, size_t index)
+{
+	uint32_t seed = 0x12345678;
+	uint32_t x, y;
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			uint32_t pix;
+
+			switch (index) {
+			case 0:
+				pix = (x * 255 / (w - 1)) << 16 |
+				      (y * 255 / (h - 1)) << 8 |
+				      ((x + y) * 255 / (w + h - 2));
+				break;
+			case 1:
+				pix = ((x ^ y) & 1) ? 0xffffff : 0x000000;
+				break;
+			case 2:
+				pix = (y & 1) ? 0xff2020 : (x & 1) ? 0x20ff20 :
+				      0x2020ff;
+				break;
+			case 3:
+				/* 6x9 "glyph" cells with a few strokes each */
+				pix = ((x % 6 == 1 && y % 9 < 7) ||
+				       (y % 9 == 3 && (x / 6 + y / 9) % 3 == 0) ||
+				       (x % 6 == 4 && (x / 6 * 7 + y / 9) % 5 < 2 &&
+					y % 9 < 7)) ? 0x101010 : 0xffffff;
+				break;
+			default:
+				seed = seed * 1664525 + 1013904223;
+				pix = seed >> 8;
+				break;
+			}
+			img[y * w + x] = 0xff000000 | pix;
+		}
+	}
+}
+
+void *spifb_image_convert(const uint32_t *img, uint32_t w, uint32_t h,
+			  enum nw_spifb_src_format format)
+{
+	size_t n = (size_t)w * h, i;
+	uint16_t *out;
+	uint8_t *c8;
+
+	if (format == NW_SPIFB_SRC_XRGB8888) {
+		uint32_t *copy = malloc(n * 4);
+
+		if (copy)
+			memcpy(copy, img, n * 4);
+		return copy;
+	}
+
+	if (format == NW_SPIFB_SRC_C8) {
+		c8 = malloc(n);
+		if (!c8)
+			return NULL;
+		for (i = 0; i < n; i++) {
+			uint32_t p = img[i];
+
+			c8[i] = ((p >> 16) & 0xe0) | ((p >> 11) & 0x1c) |
+				((p >> 6) & 0x03);
+		}
+		return c8;
+	}
+
+	out = malloc(n * 2);
+	if (!out)
+		return NULL;
+	for (i = 0; i < n; i++) {
+		uint32_t p = img[i];
+
+		out[i] = ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) |
+			 ((p >> 3) & 0x001f);
+	}
+	return out;
+}
+
+int spifb_scaler_init(struct spifb_scaler *s, const struct spifb_mode *mode,
+		      enum nw_spifb_filter filter)
+{
+	s->tables = calloc(nw_spifb_scaler_table_len(LCD_WIDTH, LCD_HEIGHT),
+			   sizeof(*s->tables));
+	s->scratch = calloc(1, nw_spifb_scratch_size(mode->vwidth));
+	if (!s->tables || !s->scratch) {
+		spifb_scaler_free(s);
+		return -1;
+	}
+
+	nw_spifb_scaler_init(&s->sc, s->tables, LCD_WIDTH, LCD_HEIGHT,
+			     mode->vwidth, mode->vheight);
+	s->sc.filter = filter;
+	return 0;
+}
+
+void spifb_scaler_free(struct spifb_scaler *s)
+{
+	free(s->tables);
+	free(s->scratch);
+	s->tables = NULL;
+	s->scratch = NULL;
+}
+
+uint32_t spifb_crc32(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint32_t crc = 0xffffffff;
+	int k;
+
+	while (len--) {
+		crc ^= *p++;
+		for (k = 0; k < 8; k++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+int spifb_write_ppm(const char *path, const uint16_t *be565, uint32_t w,
+		    uint32_t h)
+{
+	FILE *f = fopen(path, "wb");
+	size_t i;
+
+	if (!f)
+		return -1;
+
+	fprintf(f, "P6\n%u %u\n255\n", w, h);
+	for (i = 0; i < (size_t)w * h; i++) {
+		uint16_t p = be16toh(be565[i]);
+		uint8_t rgb[3] = {
+			(p >> 8 & 0xf8) | (p >> 13),
+			(p >> 3 & 0xfc) | (p >> 9 & 0x03),
+			(p << 3 & 0xf8) | (p >> 2 & 0x07),
+		};
+
+		fwrite(rgb, 1, 3, f);
+	}
+	return fclose(f);
+}
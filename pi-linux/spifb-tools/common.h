@@ -0,0 +1,67 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Shared helpers for the drm-spifb userspace tools: test patterns,
+ * checksums and image dumps around the driver's own pixel kernels.
+ */
+
+#ifndef SPIFB_TOOLS_COMMON_H
+#define SPIFB_TOOLS_COMMON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "drm-spifb-pixel.h"
+
+#define LCD_WIDTH	320
+#define LCD_HEIGHT	240
+#define LCD_PIXELS	(LCD_WIDTH * LCD_HEIGHT)
+
+struct spifb_mode {
+	uint32_t vwidth;
+	uint32_t vheight;
+};
+
+/* Virtual resolutions covered by bench and test */
+extern const struct spifb_mode spifb_modes[];
+extern const size_t spifb_num_modes;
+
+extern const char *const spifb_pattern_names[];
+extern const size_t spifb_num_patterns;
+
+const char *spifb_format_name(enum nw_spifb_src_format format);
+const char *spifb_filter_name(enum nw_spifb_filter filter);
+uint32_t spifb_format_cpp(enum nw_spifb_src_format format);
+
+/* Palette of @format's test images: RGB332 for C8, else NULL */
+const struct nw_spifb_palette *spifb_format_palette(enum nw_spifb_src_format format);
+
+/* Fill a vwidth x vheight XRGB8888 image with test pattern @index */
+void spifb_pattern(uint32_t *img, uint32_t w, uint32_t h, size_t index);
+
+/*
+ * Convert an XRGB8888 image to @format, returning a malloc'd buffer.
+ * C8 images are quantized to RGB332.
+ */
+void *spifb_image_convert(const uint32_t *img, uint32_t w, uint32_t h,
+			  enum nw_spifb_src_format format);
+
+/*
+ * A ready-to-run scaler for one mode. Owns its tables and scratch.
+ */
+struct spifb_scaler {
+	struct nw_spifb_scaler sc;
+	uint16_t *tables;
+	void *scratch;
+};
+
+int spifb_scaler_init(struct spifb_scaler *s, const struct spifb_mode *mode,
+		      enum nw_spifb_filter filter);
+void spifb_scaler_free(struct spifb_scaler *s);
+
+uint32_t spifb_crc32(const void *data, size_t len);
+
+/* Write a big-endian RGB565 frame as a binary PPM */
+int spifb_write_ppm(const char *path, const uint16_t *be565, uint32_t w,
+		    uint32_t h);
+
+#endif /* SPIFB_TOOLS_COMMON_H */
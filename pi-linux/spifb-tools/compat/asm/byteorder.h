@@ -0,0 +1,12 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace stand-in for <asm/byteorder.h>: cpu_to_be16() and friends
+ * come with compat <linux/types.h>.
+ */
+
+#ifndef __SPIFB_COMPAT_ASM_BYTEORDER_H__
+#define __SPIFB_COMPAT_ASM_BYTEORDER_H__
+
+#include <linux/types.h>
+
+#endif /* __SPIFB_COMPAT_ASM_BYTEORDER_H__ */
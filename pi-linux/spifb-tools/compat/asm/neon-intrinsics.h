@@ -0,0 +1,8 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __SPIFB_COMPAT_ASM_NEON_INTRINSICS_H__
+#define __SPIFB_COMPAT_ASM_NEON_INTRINSICS_H__
+
+#include <arm_neon.h>
+
+#endif /* __SPIFB_COMPAT_ASM_NEON_INTRINSICS_H__ */
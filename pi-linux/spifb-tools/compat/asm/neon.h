@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/* Userspace owns the NEON registers; nothing to save or restore. */
+
+#ifndef __SPIFB_COMPAT_ASM_NEON_H__
+#define __SPIFB_COMPAT_ASM_NEON_H__
+
+static inline void kernel_neon_begin(void) { }
+static inline void kernel_neon_end(void) { }
+
+#endif /* __SPIFB_COMPAT_ASM_NEON_H__ */
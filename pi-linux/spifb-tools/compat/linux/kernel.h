@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace stand-in for <linux/kernel.h>: just the helpers the pixel
+ * kernels use. CONFIG_KERNEL_MODE_NEON is set by the Makefile on ARM.
+ */
+
+#ifndef __SPIFB_COMPAT_LINUX_KERNEL_H__
+#define __SPIFB_COMPAT_LINUX_KERNEL_H__
+
+#include <string.h>
+
+#include "types.h"
+
+/* IS_ENABLED() as in <linux/kconfig.h> */
+#define __ARG_PLACEHOLDER_1 0,
+#define __take_second_arg(__ignored, val, ...) val
+#define __is_defined(x)			___is_defined(x)
+#define ___is_defined(val)		____is_defined(__ARG_PLACEHOLDER_##val)
+#define ____is_defined(arg1_or_junk)	__take_second_arg(arg1_or_junk 1, 0)
+#define IS_ENABLED(option)		__is_defined(option)
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+#define U32_MAX			UINT32_MAX
+
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)	min((t)(a), (t)(b))
+#define max_t(t, a, b)	max((t)(a), (t)(b))
+#define clamp(v, lo, hi)	min(max(v, lo), hi)
+#define clamp_t(t, v, lo, hi)	min_t(t, max_t(t, v, lo), hi)
+
+#define fallthrough	__attribute__((__fallthrough__))
+
+#endif /* __SPIFB_COMPAT_LINUX_KERNEL_H__ */
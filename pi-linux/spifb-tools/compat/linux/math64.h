@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace stand-in for <linux/math64.h>
+ */
+
+#ifndef __SPIFB_COMPAT_LINUX_MATH64_H__
+#define __SPIFB_COMPAT_LINUX_MATH64_H__
+
+#include "types.h"
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+#endif /* __SPIFB_COMPAT_LINUX_MATH64_H__ */
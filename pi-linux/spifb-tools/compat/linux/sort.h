@@ -0,0 +1,13 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace stand-in for <linux/sort.h>: qsort() without the swap hook
+ */
+
+#ifndef __SPIFB_COMPAT_LINUX_SORT_H__
+#define __SPIFB_COMPAT_LINUX_SORT_H__
+
+#include <stdlib.h>
+
+#define sort(base, num, size, cmp, swap)	qsort(base, num, size, cmp)
+
+#endif /* __SPIFB_COMPAT_LINUX_SORT_H__ */
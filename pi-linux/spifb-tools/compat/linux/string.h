@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace stand-in for <linux/string.h>
+ */
+
+#ifndef __SPIFB_COMPAT_LINUX_STRING_H__
+#define __SPIFB_COMPAT_LINUX_STRING_H__
+
+#include <string.h>
+
+#endif /* __SPIFB_COMPAT_LINUX_STRING_H__ */
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Userspace stand-in for <linux/types.h>, so the drm-spifb pixel
+ * kernels build unchanged outside the kernel.
+ */
+
+#ifndef __SPIFB_COMPAT_LINUX_TYPES_H__
+#define __SPIFB_COMPAT_LINUX_TYPES_H__
+
+#include <endian.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef int64_t s64;
+
+typedef u16 __be16;
+typedef u32 __be32;
+
+#define cpu_to_be16(x)	htobe16(x)
+#define be16_to_cpu(x)	be16toh(x)
+#define cpu_to_be32(x)	htobe32(x)
+#define be32_to_cpu(x)	be32toh(x)
+
+#endif /* __SPIFB_COMPAT_LINUX_TYPES_H__ */
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Host-side emulator of the calculator's SPI slave
+ *
+ * Follows what the STM32 firmware does on each CS assertion: look at
+ * the first 16 bytes for a v2 header, otherwise treat the message as a
+ * v1 full frame. Messages the firmware would reject are reported and
+ * dropped without touching the LCD.
+ */
+
+#include <endian.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "emu.h"
+#include "drm-spifb-wire.h"
+
+void spifb_emu_init(struct spifb_emu *emu)
+{
+	memset(emu, 0, sizeof(*emu));
+}
+
+static int spifb_emu_reject(struct spifb_emu *emu, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(emu->error, sizeof(emu->error), fmt, ap);
+	va_end(ap);
+
+	emu->errors++;
+	return -1;
+}
+
+/*
+ * Walk an RLE payload. With @lcd NULL it only checks that the runs
+ * cover the w x h window exactly and use up the payload; otherwise it
+ * expands them into the window at @lcd, whose rows are @stride pixels
+ * apart, XORing into it if @xor.
+ */
+static int spifb_emu_rle(struct spifb_emu *emu, uint16_t *lcd,
+			 const uint8_t *payload, uint32_t plen, uint32_t stride,
+			 uint32_t w, uint32_t h, int xor)
+{
+	const uint16_t *in = (const uint16_t *)payload;
+	const uint16_t *end = in + plen / 2;
+	uint32_t total = w * h, done = 0, col = 0;
+
+	if (plen & 1)
+		return spifb_emu_reject(emu, "odd RLE payload of %u bytes", plen);
+
+	while (in < end) {
+		uint16_t ctrl = be16toh(*in++);
+		uint32_t n = (ctrl & ~NW_SPIFB_RLE_REPEAT) + 1;
+		int repeat = ctrl & NW_SPIFB_RLE_REPEAT;
+		uint32_t i;
+
+		if (end - in < (repeat ? 1 : n))
+			return spifb_emu_reject(emu, "run of %u overruns payload", n);
+		if (n > total - done)
+			return spifb_emu_reject(emu, "runs overflow %ux%u window",
+						w, h);
+
+		done += n;
+		if (!lcd) {
+			in += repeat ? 1 : n;
+			continue;
+		}
+
+		for (i = 0; i < n; i++) {
+			uint16_t v = repeat ? in[0] : in[i];
+
+			*lcd = xor ? *lcd ^ v : v;
+			lcd++;
+			if (++col == w) {
+				col = 0;
+				lcd += stride - w;
+			}
+		}
+		in += repeat ? 1 : n;
+	}
+
+	if (done != total)
+		return spifb_emu_reject(emu, "runs cover %u of %u pixels", done,
+					total);
+	return 0;
+}
+
+static int spifb_emu_v2(struct spifb_emu *emu, const uint8_t *msg, size_t len)
+{
+	const struct nw_spifb_wire_hdr *hdr = (const void *)msg;
+	const uint8_t *payload = msg + sizeof(*hdr);
+	uint32_t x = be16toh(hdr->x), y = be16toh(hdr->y);
+	uint32_t w = be16toh(hdr->w), h = be16toh(hdr->h);
+	uint32_t plen = be32toh(hdr->len);
+	uint32_t enc = hdr->encoding & ~NW_SPIFB_WIRE_FIELD;
+	int field = !!(hdr->encoding & NW_SPIFB_WIRE_FIELD);
+	uint32_t stride = field ? 2 * LCD_WIDTH : LCD_WIDTH;
+	uint32_t row;
+
+	if (hdr->version != NW_SPIFB_WIRE_VERSION)
+		return spifb_emu_reject(emu, "unknown version %u", hdr->version);
+	/* A field's h rows span 2h - 1 LCD rows */
+	if (!w || !h || x + w > LCD_WIDTH ||
+	    y + (field ? 2 * h - 1 : h) > LCD_HEIGHT)
+		return spifb_emu_reject(emu, "bad window %ux%u at (%u,%u)",
+					w, h, x, y);
+	if (plen != len - sizeof(*hdr))
+		return spifb_emu_reject(emu, "header says %u payload bytes, got %zu",
+					plen, len - sizeof(*hdr));
+
+	switch (enc) {
+	case NW_SPIFB_ENC_RAW:
+		if (plen != w * h * 2)
+			return spifb_emu_reject(emu, "raw %ux%u window with %u bytes",
+						w, h, plen);
+		for (row = 0; row < h; row++)
+			memcpy(&emu->lcd[y * LCD_WIDTH + x + row * stride],
+			       payload + row * w * 2, w * 2);
+		break;
+	case NW_SPIFB_ENC_RAW_LE:
+		if (plen != w * h * 2)
+			return spifb_emu_reject(emu, "raw %ux%u window with %u bytes",
+						w, h, plen);
+		for (row = 0; row < h; row++) {
+			const uint16_t *src = (const uint16_t *)payload + row * w;
+			uint16_t *dst = &emu->lcd[y * LCD_WIDTH + x + row * stride];
+			uint32_t col;
+
+			/* What the LCD holds is big-endian, as v1 sends it */
+			for (col = 0; col < w; col++)
+				dst[col] = htobe16(le16toh(src[col]));
+		}
+		break;
+	case NW_SPIFB_ENC_RGB332:
+		if (plen != w * h)
+			return spifb_emu_reject(emu, "RGB332 %ux%u window with %u bytes",
+						w, h, plen);
+		for (row = 0; row < h; row++) {
+			const uint8_t *src = payload + row * w;
+			uint16_t *dst = &emu->lcd[y * LCD_WIDTH + x + row * stride];
+			uint32_t col;
+
+			for (col = 0; col < w; col++)
+				dst[col] = htobe16(nw_spifb_rgb332_to_rgb565(src[col]));
+		}
+		break;
+	case NW_SPIFB_ENC_RLE:
+	case NW_SPIFB_ENC_XOR_RLE:
+		/* Check first: rejected messages leave the LCD alone */
+		if (spifb_emu_rle(emu, NULL, payload, plen, stride, w, h, 0))
+			return -1;
+		spifb_emu_rle(emu, &emu->lcd[y * LCD_WIDTH + x], payload, plen,
+			      stride, w, h, enc == NW_SPIFB_ENC_XOR_RLE);
+		break;
+	default:
+		return spifb_emu_reject(emu, "unknown encoding %u", hdr->encoding);
+	}
+
+	emu->encodings[enc]++;
+	emu->fields += field;
+	emu->windows++;
+	emu->pixels += w * h;
+	return 0;
+}
+
+int spifb_emu_feed(struct spifb_emu *emu, const void *msg, size_t len)
+{
+	const struct nw_spifb_wire_hdr *hdr = msg;
+
+	emu->messages++;
+	emu->bytes += len;
+
+	if (len >= sizeof(*hdr) && be16toh(hdr->magic) == NW_SPIFB_WIRE_MAGIC)
+		return spifb_emu_v2(emu, msg, len);
+
+	if (len != sizeof(emu->lcd))
+		return spifb_emu_reject(emu, "v1 frame of %zu bytes", len);
+
+	memcpy(emu->lcd, msg, len);
+	emu->frames++;
+	emu->pixels += LCD_PIXELS;
+	return 0;
+}
+
+int spifb_capture_write(FILE *f, const void *msg, uint32_t len)
+{
+	uint32_t le = htole32(len);
+
+	if (fwrite(&le, sizeof(le), 1, f) != 1 ||
+	    fwrite(msg, 1, len, f) != len)
+		return -1;
+	return 0;
+}
+
+long spifb_capture_read(FILE *f, void *buf, size_t size)
+{
+	uint32_t le, len;
+
+	if (fread(&le, sizeof(le), 1, f) != 1)
+		return 0;
+
+	len = le32toh(le);
+	if (len > size || fread(buf, 1, len, f) != len)
+		return -1;
+	return len;
+}
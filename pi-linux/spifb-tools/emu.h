@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Host-side emulator of the calculator's SPI slave, and the capture
+ * file format it reads.
+ *
+ * A capture is a sequence of records, one per CS assertion:
+ *
+ *   u32 length (little-endian) | length bytes as clocked on MOSI
+ */
+
+#ifndef SPIFB_TOOLS_EMU_H
+#define SPIFB_TOOLS_EMU_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "drm-spifb-wire.h"
+
+struct spifb_emu {
+	uint16_t lcd[LCD_PIXELS];	/* Big-endian RGB565, as sent */
+
+	unsigned long messages;
+	unsigned long frames;		/* v1 full frames */
+	unsigned long windows;		/* v2 windows */
+	unsigned long encodings[NW_SPIFB_ENCODINGS];	/* v2 windows per encoding */
+	unsigned long fields;		/* ...of which alternate rows only */
+	unsigned long errors;
+	uint64_t bytes;			/* Everything clocked, headers included */
+	uint64_t pixels;		/* LCD pixels written */
+
+	char error[128];		/* Why the last rejected message was */
+};
+
+void spifb_emu_init(struct spifb_emu *emu);
+
+/*
+ * Decode one CS assertion's worth of bytes the way the STM32 does and
+ * apply it to the LCD. Returns 0, or -1 with emu->error set if the
+ * slave would reject the message (the LCD is left untouched).
+ */
+int spifb_emu_feed(struct spifb_emu *emu, const void *msg, size_t len);
+
+int spifb_capture_write(FILE *f, const void *msg, uint32_t len);
+
+/*
+ * Read the next record into @buf (@size bytes). Returns its length,
+ * 0 at end of file, or -1 if the record is truncated or too large.
+ */
+long spifb_capture_read(FILE *f, void *buf, size_t size);
+
+#endif /* SPIFB_TOOLS_EMU_H */
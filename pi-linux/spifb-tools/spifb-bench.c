@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * spifb-bench - throughput of the drm-spifb pixel kernels
+ *
+ * Times a full 320x240 frame for every source format, virtual mode and
+ * filter, and reports ns per output pixel and MB/s of source read:
+ *
+ *   cached   source in ordinary malloc'd memory, warm in cache
+ *   cold     the same malloc'd source, with the caches evicted before
+ *            every frame. This is still cacheable memory with line
+ *            fills and prefetch, so it is not what the driver reads
+ *            and says nothing about write-combined sources
+ *   wc       with -d: a real DRM dumb buffer, which is write-combined
+ *            on the Pi just like the compositor's framebuffer
+ *   staged   with -d: the wc source copied row-wise into a cached
+ *            buffer first, as the driver does with staging=1 (copy
+ *            included)
+ *
+ * Only -d on the Pi measures what staging saves; without it the
+ * staged column is not printed.
+ *
+ * Usage: spifb-bench [-n frames] [-d /dev/dri/cardN]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+
+/* From <drm/drm_mode.h>, to avoid depending on libdrm headers */
+struct drm_mode_create_dumb {
+	uint32_t height;
+	uint32_t width;
+	uint32_t bpp;
+	uint32_t flags;
+	uint32_t handle;
+	uint32_t pitch;
+	uint64_t size;
+};
+
+struct drm_mode_map_dumb {
+	uint32_t handle;
+	uint32_t pad;
+	uint64_t offset;
+};
+
+#define DRM_IOCTL_MODE_CREATE_DUMB	_IOWR('d', 0xB2, struct drm_mode_create_dumb)
+#define DRM_IOCTL_MODE_MAP_DUMB		_IOWR('d', 0xB3, struct drm_mode_map_dumb)
+
+#define EVICT_SIZE	(32 << 20)	/* Comfortably larger than any L2 */
+
+static uint8_t *evict_buf;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void evict_caches(void)
+{
+	static uint8_t gen;
+	size_t i;
+
+	gen++;
+	for (i = 0; i < EVICT_SIZE; i += 64)
+		evict_buf[i] = gen;
+}
+
+/* A source buffer, either malloc'd or a mapped dumb buffer */
+struct source {
+	uint8_t *base;
+	uint32_t pitch;
+	size_t map_size;	/* Non-zero for dumb buffers */
+};
+
+static int source_alloc(struct source *s, int drm_fd, uint32_t w, uint32_t h,
+			uint32_t cpp)
+{
+	struct drm_mode_create_dumb create = {
+		.width = w, .height = h, .bpp = cpp * 8,
+	};
+	struct drm_mode_map_dumb map = { 0 };
+	void *p;
+
+	if (drm_fd < 0) {
+		s->pitch = w * cpp;
+		s->base = malloc((size_t)s->pitch * h);
+		s->map_size = 0;
+		return s->base ? 0 : -ENOMEM;
+	}
+
+	if (ioctl(drm_fd, DRM_IOCTL_MODE_CREATE_DUMB, &create) ||
+	    (map.handle = create.handle,
+	     ioctl(drm_fd, DRM_IOCTL_MODE_MAP_DUMB, &map)))
+		return -errno;
+
+	p = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 drm_fd, map.offset);
+	if (p == MAP_FAILED)
+		return -errno;
+
+	s->base = p;
+	s->pitch = create.pitch;
+	s->map_size = create.size;
+	return 0;
+}
+
+static void source_free(struct source *s)
+{
+	if (s->map_size)
+		munmap(s->base, s->map_size);
+	else
+		free(s->base);
+}
+
+static void source_fill(struct source *s, const void *pixels, uint32_t w,
+			uint32_t h, uint32_t cpp)
+{
+	uint32_t y;
+
+	for (y = 0; y < h; y++)
+		memcpy(s->base + y * s->pitch, (const uint8_t *)pixels + y * w * cpp,
+		       w * cpp);
+}
+
+enum bench_kind { BENCH_CACHED, BENCH_UNCACHED, BENCH_STAGED };
+
+static double bench(const struct spifb_scaler *s, const struct source *in,
+		    uint8_t *stage, enum nw_spifb_src_format fmt, uint32_t cpp,
+		    enum bench_kind kind, bool cold, int frames)
+{
+	static uint16_t out[LCD_PIXELS];
+	struct nw_spifb_src src = {
+		.base = in->base, .pitch = in->pitch, .format = fmt,
+		.palette = spifb_format_palette(fmt),
+	};
+	double total = 0;
+	int i;
+
+	if (kind == BENCH_STAGED) {
+		src.base = stage;
+		src.pitch = s->sc.vwidth * cpp;
+	}
+
+	for (i = 0; i < frames; i++) {
+		double t0;
+		uint32_t y;
+
+		if (kind != BENCH_CACHED && cold)
+			evict_caches();
+
+		t0 = now_ns();
+		if (kind == BENCH_STAGED)
+			for (y = 0; y < s->sc.vheight; y++)
+				memcpy(stage + y * src.pitch, in->base + y * in->pitch,
+				       src.pitch);
+		nw_spifb_scale_rows(&s->sc, &src, out, 0, LCD_HEIGHT, s->scratch);
+		total += now_ns() - t0;
+	}
+
+	return total / frames;
+}
+
+static void report(double ns, uint32_t vw, uint32_t vh, uint32_t cpp)
+{
+	printf(" %7.2f %7.0f", ns / LCD_PIXELS,
+	       (double)vw * vh * cpp / ns * 1e3);
+}
+
+int main(int argc, char **argv)
+{
+	const char *drm_path = NULL;
+	int frames = 50, drm_fd = -1;
+	size_t m;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = atoi(optarg);
+			break;
+		case 'd':
+			drm_path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n frames] [-d /dev/dri/cardN]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (frames < 1)
+		frames = 1;
+
+	if (drm_path) {
+		drm_fd = open(drm_path, O_RDWR | O_CLOEXEC);
+		if (drm_fd < 0) {
+			perror(drm_path);
+			return 1;
+		}
+	} else {
+		evict_buf = malloc(EVICT_SIZE);
+		if (!evict_buf)
+			return 1;
+	}
+
+	printf("%d frames/case, %s, %s kernels\n", frames,
+	       drm_path ? "wc = dumb buffer" :
+			  "cold = malloc'd with caches evicted, not WC (use -d)",
+#ifdef NW_SPIFB_HAVE_NEON
+	       "NEON"
+#else
+	       "scalar"
+#endif
+	       );
+	if (drm_path) {
+		printf("%-30s %15s %15s %15s\n", "", "cached", "wc", "staged");
+		printf("%-30s %7s %7s %7s %7s %7s %7s\n", "case",
+		       "ns/px", "MB/s", "ns/px", "MB/s", "ns/px", "MB/s");
+	} else {
+		printf("%-30s %15s %15s\n", "", "cached", "cold");
+		printf("%-30s %7s %7s %7s %7s\n", "case",
+		       "ns/px", "MB/s", "ns/px", "MB/s");
+	}
+
+	for (m = 0; m < spifb_num_modes; m++) {
+		const struct spifb_mode *mode = &spifb_modes[m];
+		uint32_t vw = mode->vwidth, vh = mode->vheight;
+		uint32_t *img = malloc((size_t)vw * vh * 4);
+		uint8_t *stage = malloc((size_t)vw * vh * 4);
+		int fmt, filt;
+
+		if (!img || !stage)
+			return 1;
+		spifb_pattern(img, vw, vh, 0);
+
+		for (fmt = NW_SPIFB_SRC_XRGB8888; fmt <= NW_SPIFB_SRC_C8; fmt++) {
+			uint32_t cpp = spifb_format_cpp(fmt);
+			void *pixels = spifb_image_convert(img, vw, vh, fmt);
+			struct source cached, uncached;
+			int ret;
+
+			if (!pixels || source_alloc(&cached, -1, vw, vh, cpp))
+				return 1;
+			ret = source_alloc(&uncached, drm_fd, vw, vh, cpp);
+			if (ret) {
+				fprintf(stderr, "source: %s\n", strerror(-ret));
+				return 1;
+			}
+			source_fill(&cached, pixels, vw, vh, cpp);
+			source_fill(&uncached, pixels, vw, vh, cpp);
+
+			for (filt = NW_SPIFB_FILTER_NEAREST; filt <= NW_SPIFB_FILTER_BOX; filt++) {
+				struct spifb_scaler s;
+				char name[64];
+
+				if (spifb_scaler_init(&s, mode, filt))
+					return 1;
+
+				snprintf(name, sizeof(name), "%s %ux%u %s",
+					 spifb_format_name(fmt), vw, vh,
+					 spifb_filter_name(filt));
+				printf("%-30s", name);
+				report(bench(&s, &cached, stage, fmt, cpp,
+					     BENCH_CACHED, false, frames), vw, vh, cpp);
+				report(bench(&s, &uncached, stage, fmt, cpp,
+					     BENCH_UNCACHED, !drm_path, frames), vw, vh, cpp);
+				if (drm_path)
+					report(bench(&s, &uncached, stage, fmt, cpp,
+						     BENCH_STAGED, false, frames),
+					       vw, vh, cpp);
+				printf("\n");
+				spifb_scaler_free(&s);
+			}
+
+			source_free(&cached);
+			source_free(&uncached);
+			free(pixels);
+		}
+		free(img);
+		free(stage);
+	}
+
+	return 0;
+}
@@ -0,0 +1,361 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * spifb-codec - size and speed of the v2 wire encodings
+ *
+ * Sends a sequence of LCD frames through the driver's wire encoder with
+ * every encoding, decodes each message in the slave emulator and checks
+ * the result, then reports per encoding:
+ *
+ *   bytes    average message size, headers included
+ *   ratio    against a v1 full frame (153,600 bytes)
+ *   enc/dec  microseconds per message on this machine
+ *   bus      SPI time per message and the FPS ceiling that implies
+ *
+ * Each message carries the bounding box of the pixels that changed,
+ * standing in for the driver's damage window; unchanged frames are
+ * skipped, as the driver does.
+ *
+ * Frames come from capture files (every LCD state the capture passes
+ * through), or from three built-in synthetic scenes when none are
+ * given: a mostly static desktop with a moving cursor and ticking
+ * clock, a terminal being typed into and scrolling, and a Doom-like
+ * full-screen 3D view with a static status bar.
+ *
+ * Usage: spifb-codec [-n frames] [-s hz] [capture.bin ...]
+ */
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "emu.h"
+#include "drm-spifb-wire.h"
+
+#define MAX_FRAMES	4096
+
+static const char *const enc_names[] = { "raw", "rle", "xor-rle" };
+
+struct scene {
+	const char *name;
+	uint16_t **frames;
+	size_t count;
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint16_t rgb(uint32_t r, uint32_t g, uint32_t b)
+{
+	return htobe16(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+static uint32_t hash32(uint32_t x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	return x ^ (x >> 16);
+}
+
+static void fill(uint16_t *f, int x, int y, int w, int h, uint16_t c)
+{
+	int i, j;
+
+	for (j = y; j < y + h; j++)
+		for (i = x; i < x + w; i++)
+			if (i >= 0 && i < LCD_WIDTH && j >= 0 && j < LCD_HEIGHT)
+				f[j * LCD_WIDTH + i] = c;
+}
+
+/* A made-up 5x7 glyph per character code, drawn in an 8x12 cell */
+static void glyph(uint16_t *f, int x, int y, uint32_t ch, uint16_t fg)
+{
+	uint32_t bits = hash32(ch * 2654435761u);
+	int i, j;
+
+	for (j = 0; j < 7; j++)
+		for (i = 0; i < 5; i++)
+			if ((bits >> ((j * 5 + i) % 32)) & 1)
+				fill(f, x + 1 + i, y + 2 + j, 1, 1, fg);
+}
+
+static uint16_t *frame_new(const uint16_t *prev)
+{
+	uint16_t *f = malloc(LCD_PIXELS * 2);
+
+	if (f && prev)
+		memcpy(f, prev, LCD_PIXELS * 2);
+	return f;
+}
+
+static void desktop(uint16_t *f, size_t n)
+{
+	static const uint8_t arrow[19] = {
+		1, 3, 7, 15, 31, 63, 127, 255, 255, 31, 27, 49, 48, 96, 96,
+		192, 192, 0, 0,
+	};
+	int cx = 40 + n * 3 % 240, cy = 60 + n * 2 % 150;
+	int i, j;
+
+	fill(f, 0, 0, LCD_WIDTH, LCD_HEIGHT, rgb(0x3a, 0x6e, 0xa5));
+	fill(f, 0, 0, LCD_WIDTH, 16, rgb(0x30, 0x30, 0x30));
+	for (i = 0; i < 5; i++)		/* Clock, ticking every 30 frames */
+		glyph(f, 270 + i * 8, 2, n / 30 * 7 + i, rgb(0xff, 0xff, 0xff));
+
+	fill(f, 30, 40, 200, 140, rgb(0xf0, 0xf0, 0xf0));
+	fill(f, 30, 40, 200, 14, rgb(0x50, 0x50, 0x80));
+	for (j = 0; j < 8; j++)
+		for (i = 0; i < 22; i++)
+			glyph(f, 36 + i * 8, 60 + j * 14, j * 31 + i, rgb(0, 0, 0));
+
+	for (j = 0; j < 19; j++)
+		for (i = 0; i < 8; i++)
+			if (arrow[j] >> i & 1)
+				fill(f, cx + i, cy + j, 1, 1, rgb(0xff, 0xff, 0xff));
+}
+
+static void terminal(uint16_t *f, size_t n)
+{
+	const int cols = LCD_WIDTH / 8, rows = LCD_HEIGHT / 12;
+	size_t chars = n * 8;	/* Typing speed, scrolls after ~100 frames */
+	size_t line = chars / cols, first = line >= (size_t)rows ?
+					    line - rows + 1 : 0;
+	size_t c;
+
+	fill(f, 0, 0, LCD_WIDTH, LCD_HEIGHT, 0);
+	for (c = first * cols; c <= chars; c++) {
+		int x = c % cols * 8, y = (c / cols - first) * 12;
+
+		if (hash32(c) % 7)	/* Some spaces */
+			glyph(f, x, y, c, rgb(0xc0, 0xc0, 0xc0));
+	}
+	fill(f, (chars + 1) % cols * 8, (line - first) * 12 + 10, 8, 2,
+	     rgb(0xc0, 0xc0, 0xc0));
+}
+
+static void doom(uint16_t *f, size_t n)
+{
+	const int view = LCD_HEIGHT - 32, horizon = view / 2;
+	int cam = n * 5, x, y;
+
+	for (y = 0; y < view; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			/* Wall columns with a per-column height, textured */
+			int u = (x + cam) / 2, col = u / 16;
+			int half = 30 + hash32(col) % 50;
+			uint32_t t = hash32(u * 131 + y / 2 * 7) & 0x1f;
+			uint16_t c;
+
+			if (y < horizon - half)
+				c = rgb(0x40 + y / 2, 0x40 + y / 2, 0x48 + y / 2);
+			else if (y < horizon + half)
+				c = rgb(0x60 + t * 3, 0x40 + t * 2, 0x20 + t);
+			else
+				c = rgb(0x30 + t + y / 8, 0x28 + t, 0x20);
+			f[y * LCD_WIDTH + x] = c;
+		}
+	}
+
+	fill(f, 0, view, LCD_WIDTH, 32, rgb(0x50, 0x50, 0x50));
+	for (x = 0; x < 3; x++)		/* Ammo counter */
+		glyph(f, 40 + x * 8, view + 10, 100 + n / 20 + x,
+		      rgb(0xd0, 0x20, 0x20));
+}
+
+static int synth(struct scene *s, const char *name,
+		 void (*draw)(uint16_t *f, size_t n), size_t count)
+{
+	size_t i;
+
+	s->name = name;
+	s->frames = calloc(count, sizeof(*s->frames));
+	if (!s->frames)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		s->frames[i] = frame_new(NULL);
+		if (!s->frames[i])
+			return -1;
+		draw(s->frames[i], i);
+	}
+	s->count = count;
+	return 0;
+}
+
+/* Every LCD state a capture passes through */
+static int load(struct scene *s, const char *path)
+{
+	static struct spifb_emu emu;
+	size_t max = nw_spifb_wire_max_len(LCD_WIDTH, LCD_HEIGHT);
+	uint8_t *msg = malloc(max);
+	FILE *f = fopen(path, "rb");
+	long len;
+
+	s->name = path;
+	s->frames = calloc(MAX_FRAMES, sizeof(*s->frames));
+	s->count = 0;
+	if (!f || !msg || !s->frames) {
+		perror(path);
+		return -1;
+	}
+
+	spifb_emu_init(&emu);
+	while ((len = spifb_capture_read(f, msg, max)) > 0 &&
+	       s->count < MAX_FRAMES) {
+		if (spifb_emu_feed(&emu, msg, len))
+			continue;
+		s->frames[s->count] = frame_new(emu.lcd);
+		if (!s->frames[s->count])
+			return -1;
+		s->count++;
+	}
+
+	fclose(f);
+	free(msg);
+	return s->count ? 0 : -1;
+}
+
+/* Bounding box of the pixels that differ, false if none do */
+static int diff_box(const uint16_t *a, const uint16_t *b, uint32_t box[4])
+{
+	uint32_t x0 = LCD_WIDTH, y0 = LCD_HEIGHT, x1 = 0, y1 = 0, x, y;
+
+	for (y = 0; y < LCD_HEIGHT; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			if (a[y * LCD_WIDTH + x] == b[y * LCD_WIDTH + x])
+				continue;
+			x0 = x < x0 ? x : x0;
+			x1 = x + 1 > x1 ? x + 1 : x1;
+			y0 = y < y0 ? y : y0;
+			y1 = y + 1;
+		}
+	}
+	if (x1 <= x0)
+		return 0;
+
+	box[0] = x0;
+	box[1] = y0;
+	box[2] = x1 - x0;
+	box[3] = y1 - y0;
+	return 1;
+}
+
+static int run(const struct scene *s, int enc, unsigned long speed)
+{
+	static struct spifb_emu emu;
+	uint8_t *msg = malloc(nw_spifb_wire_max_len(LCD_WIDTH, LCD_HEIGHT));
+	double enc_ns = 0, dec_ns = 0, t;
+	unsigned long chosen[3] = { 0 };
+	uint64_t bytes = 0;
+	size_t i, sent = 0;
+	double avg, bus_ms;
+
+	if (!msg)
+		return -1;
+
+	/* The LCD starts out showing the first frame */
+	spifb_emu_init(&emu);
+	memcpy(emu.lcd, s->frames[0], sizeof(emu.lcd));
+
+	for (i = 1; i < s->count; i++) {
+		uint32_t box[4];
+		size_t len;
+
+		if (!diff_box(emu.lcd, s->frames[i], box))
+			continue;
+
+		t = now_ns();
+		len = nw_spifb_wire_encode(msg, s->frames[i], emu.lcd, LCD_WIDTH,
+					   box[0], box[1], box[2], box[3], enc,
+					   false);
+		enc_ns += now_ns() - t;
+
+		t = now_ns();
+		if (spifb_emu_feed(&emu, msg, len)) {
+			printf("%s: %s message %zu rejected: %s\n", s->name,
+			       enc_names[enc], i, emu.error);
+			free(msg);
+			return -1;
+		}
+		dec_ns += now_ns() - t;
+
+		if (memcmp(emu.lcd, s->frames[i], sizeof(emu.lcd))) {
+			printf("%s: %s frame %zu decodes wrong\n", s->name,
+			       enc_names[enc], i);
+			free(msg);
+			return -1;
+		}
+
+		chosen[((struct nw_spifb_wire_hdr *)msg)->encoding]++;
+		bytes += len;
+		sent++;
+	}
+	free(msg);
+
+	if (!sent) {
+		printf("%-10s %-8s no changes\n", s->name, enc_names[enc]);
+		return 0;
+	}
+
+	avg = (double)bytes / sent;
+	bus_ms = avg * 8 * 1e3 / speed;
+	printf("%-10s %-8s %9.0f %6.1f%% %7.1f %7.1f %7.2f %7.0f   %lu/%lu/%lu\n",
+	       s->name, enc_names[enc], avg, avg * 100 / (LCD_PIXELS * 2),
+	       enc_ns / sent / 1e3, dec_ns / sent / 1e3, bus_ms, 1e3 / bus_ms,
+	       chosen[0], chosen[1], chosen[2]);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct scene scenes[16];
+	size_t num_scenes = 0, frames = 120, i;
+	unsigned long speed = 66666666;
+	int opt, enc, ret = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			speed = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n frames] [-s hz] [capture.bin ...]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (frames < 2 || !speed)
+		return 2;
+
+	if (optind == argc) {
+		if (synth(&scenes[0], "desktop", desktop, frames) ||
+		    synth(&scenes[1], "terminal", terminal, frames) ||
+		    synth(&scenes[2], "doom", doom, frames))
+			return 1;
+		num_scenes = 3;
+	}
+	for (; optind < argc && num_scenes < ARRAY_SIZE(scenes); optind++)
+		if (load(&scenes[num_scenes++], argv[optind]))
+			return 1;
+
+	printf("%-10s %-8s %9s %7s %7s %7s %7s %7s   %s\n", "scene", "encoding",
+	       "bytes", "ratio", "enc us", "dec us", "bus ms", "max fps",
+	       "raw/rle/xor");
+	for (i = 0; i < num_scenes; i++)
+		for (enc = NW_SPIFB_ENC_RAW; enc <= NW_SPIFB_ENC_XOR_RLE; enc++)
+			ret |= run(&scenes[i], enc, speed);
+
+	return ret ? 1 : 0;
+}
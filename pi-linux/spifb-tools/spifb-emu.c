@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * spifb-emu - decode a drm-spifb SPI capture as the calculator would
+ *
+ * Feeds every record of a capture file (see emu.h) through the slave
+ * emulator and reports what each CS assertion did to the LCD, plus the
+ * bus time all of it would take at the given SPI clock.
+ *
+ * Usage: spifb-emu [-v] [-s hz] [-d dumpdir] [-o final.ppm] capture.bin
+ *   -v  one line per message
+ *   -s  SPI clock for the bus time estimate (default 70000000)
+ *   -d  write the LCD contents after every message as a PPM
+ *   -o  write the final LCD contents as a PPM
+ */
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "emu.h"
+#include "drm-spifb-wire.h"
+
+static void describe(const struct spifb_emu *emu, unsigned long n,
+		     const uint8_t *msg, long len, int ret)
+{
+	const struct nw_spifb_wire_hdr *hdr = (const void *)msg;
+
+	if (ret) {
+		printf("%6lu: %7ld bytes  REJECTED: %s\n", n, len, emu->error);
+	} else if (len >= (long)sizeof(*hdr) &&
+		   be16toh(hdr->magic) == NW_SPIFB_WIRE_MAGIC) {
+		printf("%6lu: %7ld bytes  v2 enc %u %ux%u at (%u,%u)\n", n, len,
+		       hdr->encoding, be16toh(hdr->w), be16toh(hdr->h),
+		       be16toh(hdr->x), be16toh(hdr->y));
+	} else {
+		printf("%6lu: %7ld bytes  v1 frame\n", n, len);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static struct spifb_emu emu;
+	const char *dump_dir = NULL, *final_ppm = NULL;
+	unsigned long speed = 70000000;
+	size_t max = nw_spifb_wire_max_len(LCD_WIDTH, LCD_HEIGHT);
+	uint8_t *msg = malloc(max);
+	int verbose = 0;
+	FILE *f;
+	long len;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "vs:d:o:")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 's':
+			speed = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dump_dir = optarg;
+			break;
+		case 'o':
+			final_ppm = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1 || !speed)
+		goto usage;
+
+	f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (!msg)
+		return 1;
+
+	spifb_emu_init(&emu);
+
+	while ((len = spifb_capture_read(f, msg, max)) > 0) {
+		int ret = spifb_emu_feed(&emu, msg, len);
+
+		if (verbose || ret)
+			describe(&emu, emu.messages, msg, len, ret);
+
+		if (dump_dir) {
+			char path[256];
+
+			snprintf(path, sizeof(path), "%s/%06lu.ppm", dump_dir,
+				 emu.messages);
+			if (spifb_write_ppm(path, emu.lcd, LCD_WIDTH, LCD_HEIGHT))
+				perror(path);
+		}
+	}
+	if (len < 0)
+		fprintf(stderr, "%s: truncated record after message %lu\n",
+			argv[optind], emu.messages);
+	fclose(f);
+
+	if (final_ppm && spifb_write_ppm(final_ppm, emu.lcd, LCD_WIDTH, LCD_HEIGHT))
+		perror(final_ppm);
+
+	printf("%lu messages: %lu v1 frames, %lu v2 windows (%lu fields), %lu rejected\n",
+	       emu.messages, emu.frames, emu.windows, emu.fields, emu.errors);
+	printf("%llu bytes, %llu LCD pixels written, %.1f ms bus time at %lu Hz\n",
+	       (unsigned long long)emu.bytes, (unsigned long long)emu.pixels,
+	       emu.bytes * 8 * 1e3 / speed, speed);
+
+	free(msg);
+	return emu.errors || len < 0 ? 1 : 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-v] [-s hz] [-d dumpdir] [-o final.ppm] capture.bin\n",
+		argv[0]);
+	return 2;
+}
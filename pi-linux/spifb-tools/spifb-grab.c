@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * spifb-grab - save the frame drm-spifb last converted and sent
+ *
+ * Maps the driver's debugfs 'converted' capture and writes it as a PPM,
+ * or as the raw big-endian RGB565 it is. This is the frame before the
+ * wire: with an RGB332 wire or fields, the LCD shows it quantised or
+ * only half updated. 'converted_seq' is read before and after opening
+ * the capture, and the grab retried if a newer frame was sent in
+ * between, so the printed sequence number is the one the image belongs
+ * to (as in the drm_spifb tracepoints).
+ *
+ * Usage: spifb-grab [-d debugfs-dir] [-r] out.ppm
+ *   -d  the card's debugfs directory (default /sys/kernel/debug/dri/0)
+ *   -r  write raw big-endian RGB565 instead of a PPM
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "common.h"
+
+#define FRAME_SIZE	(LCD_PIXELS * 2)
+#define MAX_TRIES	10
+
+static int read_seq(const char *dir, uint64_t *seq)
+{
+	char path[256];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/converted_seq", dir);
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+	ret = fscanf(f, "%" SCNu64, seq) == 1 ? 0 : -EIO;
+	fclose(f);
+	return ret;
+}
+
+static int write_raw(const char *path, const void *frame)
+{
+	FILE *f = fopen(path, "wb");
+
+	if (!f)
+		return -1;
+	fwrite(frame, 1, FRAME_SIZE, f);
+	return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = "/sys/kernel/debug/dri/0";
+	char path[256];
+	uint64_t before, after;
+	void *frame = MAP_FAILED;
+	int raw = 0, tries, fd = -1;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "d:r")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'r':
+			raw = 1;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1)
+		goto usage;
+
+	snprintf(path, sizeof(path), "%s/converted", dir);
+
+	for (tries = 0; tries < MAX_TRIES; tries++) {
+		ret = read_seq(dir, &before);
+		if (ret)
+			break;
+
+		/* Each open is a fresh copy of the last frame sent */
+		fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			ret = -errno;
+			break;
+		}
+		ret = read_seq(dir, &after);
+		if (ret || before == after)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	if (!ret && tries == MAX_TRIES)
+		ret = -EAGAIN;
+	if (ret) {
+		fprintf(stderr, "%s: %s\n", path, strerror(-ret));
+		return 1;
+	}
+
+	frame = mmap(NULL, FRAME_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	if (frame == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (raw)
+		ret = write_raw(argv[optind], frame);
+	else
+		ret = spifb_write_ppm(argv[optind], frame, LCD_WIDTH, LCD_HEIGHT);
+	if (ret) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	printf("frame %" PRIu64 "\n", before);
+
+	munmap(frame, FRAME_SIZE);
+	close(fd);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-d debugfs-dir] [-r] out.ppm\n", argv[0]);
+	return 2;
+}
@@ -0,0 +1,1269 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * spifb-test - golden-image regression test for the drm-spifb pixel kernels
+ *
+ * Scales every test pattern through every source format, virtual mode
+ * and filter, and compares a CRC32 of each 320x240 output against
+ * golden.txt. On ARM the NEON kernels are built in, so the same golden
+ * values also prove NEON and scalar output are identical.
+ *
+ * Also checks that nearest output is exactly the source pixel each
+ * output pixel maps to, that nw_spifb_scaler_span() covers every output
+ * pixel a source change can reach, that scaling a rectangle touches only
+ * that rectangle, that v2 wire messages decode in the slave emulator
+ * to exactly the frames they were cut from, that RGB332 messages round
+ * and dither towards the right levels, that 8-bit palette lookups
+ * match their XRGB8888 expansion, that a blended cursor and a YUV
+ * overlay match the same drawn into the source, that zero-copy is
+ * only taken in the 1:1 mode, that colour tables match colour
+ * management done in floating point, and that the driver's timing
+ * histograms report the right percentiles.
+ *
+ * Usage: spifb-test [-u] [-g golden.txt] [-d dumpdir] [-c capture.bin]
+ *   -u  rewrite the golden file from the current output
+ *   -d  write every output frame as a PPM for inspection
+ *   -c  write the wire test's messages as a capture for spifb-emu
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "emu.h"
+#include "drm-spifb-stats.h"
+#include "drm-spifb-wire.h"
+
+#define MAX_CASES	256
+
+struct golden {
+	char name[64];
+	uint32_t crc;
+};
+
+static struct golden golden[MAX_CASES];
+static size_t num_golden;
+
+static int load_golden(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[128];
+
+	if (!f)
+		return -errno;
+
+	while (fgets(line, sizeof(line), f) && num_golden < MAX_CASES) {
+		struct golden *g = &golden[num_golden];
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "%63s %x", g->name, &g->crc) == 2)
+			num_golden++;
+	}
+	fclose(f);
+	return 0;
+}
+
+static const struct golden *find_golden(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < num_golden; i++)
+		if (!strcmp(golden[i].name, name))
+			return &golden[i];
+	return NULL;
+}
+
+/* Scaling in bands must give the same frame as scaling in one go */
+static int check_bands(const struct spifb_scaler *s,
+		       const struct nw_spifb_src *src, const uint16_t *whole)
+{
+	static uint16_t banded[LCD_PIXELS];
+	uint32_t y;
+
+	memset(banded, 0, sizeof(banded));
+	for (y = 0; y < LCD_HEIGHT; y += 7)
+		nw_spifb_scale_rows(&s->sc, src, banded, y,
+				    y + 7 < LCD_HEIGHT ? y + 7 : LCD_HEIGHT,
+				    s->scratch);
+
+	return memcmp(banded, whole, sizeof(banded)) ? -1 : 0;
+}
+
+/*
+ * Scaling a rectangle must write exactly the frame's pixels there, and
+ * leave the rest alone apart from the kernels' column widening.
+ */
+static int check_rects(const struct spifb_scaler *s,
+		       const struct nw_spifb_src *src, const uint16_t *whole)
+{
+	static const uint32_t rects[][4] = {
+		{ 0, 0, 1, 1 },
+		{ 319, 239, 320, 240 },
+		{ 101, 37, 158, 90 },
+		{ 7, 0, 8, 240 },
+		{ 0, 120, 320, 121 },
+	};
+	static uint16_t part[LCD_PIXELS];
+	size_t r;
+	uint32_t x, y;
+
+	for (r = 0; r < ARRAY_SIZE(rects); r++) {
+		const uint32_t *rc = rects[r];
+
+		memset(part, 0xa5, sizeof(part));
+		nw_spifb_scale_rect(&s->sc, src, part, rc[0], rc[1], rc[2],
+				    rc[3], s->scratch);
+
+		for (y = 0; y < LCD_HEIGHT; y++) {
+			for (x = 0; x < LCD_WIDTH; x++) {
+				uint32_t i = y * LCD_WIDTH + x;
+				int inside = x >= rc[0] && x < rc[2] &&
+					     y >= rc[1] && y < rc[3];
+				int widened = y >= rc[1] && y < rc[3] &&
+					      x + 1 >= rc[0] && x <= rc[2];
+
+				if (inside ? part[i] != whole[i] :
+				    part[i] != 0xa5a5 &&
+				    (part[i] != whole[i] || !widened))
+					return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * Nearest output must be the source pixel at (x * vw / w, y * vh / h),
+ * whichever kernel the ratio picks, upscaling included.
+ */
+static int check_nearest(const struct spifb_scaler *s, const uint32_t *img,
+			 const uint16_t *out)
+{
+	const struct nw_spifb_scaler *sc = &s->sc;
+	uint32_t x, y;
+
+	for (y = 0; y < LCD_HEIGHT; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			uint32_t p = img[y * sc->vheight / LCD_HEIGHT * sc->vwidth +
+					 x * sc->vwidth / LCD_WIDTH];
+			uint16_t want = ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) |
+					((p >> 3) & 0x001f);
+
+			if (be16toh(out[y * LCD_WIDTH + x]) != want)
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Zero-copy only in a 1:1 mode. A panel-sized RGB565 framebuffer in
+ * the 2x upscaled mode must be scaled instead: its top left quarter,
+ * upscaled, is what the emulated LCD has to show after the frame.
+ */
+static int check_zero_copy(FILE *capture)
+{
+	static const struct spifb_mode up = { LCD_WIDTH / 2, LCD_HEIGHT / 2 };
+	static struct spifb_emu emu;
+	static uint16_t out[LCD_PIXELS];
+	struct nw_spifb_src src = {
+		.pitch = LCD_WIDTH * 2,		/* Panel-sized framebuffer */
+		.format = NW_SPIFB_SRC_RGB565,
+	};
+	uint32_t *img = malloc(LCD_PIXELS * 4);
+	uint16_t *fb = NULL;
+	struct spifb_scaler s;
+	uint32_t x, y;
+	size_t m;
+	int ret = 0;
+
+	if (!img)
+		return -1;
+
+	for (m = 0; m < spifb_num_modes; m++) {
+		const struct spifb_mode *mode = &spifb_modes[m];
+		bool native = mode->vwidth == LCD_WIDTH &&
+			      mode->vheight == LCD_HEIGHT;
+
+		if (spifb_scaler_init(&s, mode, NW_SPIFB_FILTER_NEAREST))
+			goto fail;
+		if (nw_spifb_scaler_passthrough(&s.sc, LCD_WIDTH, LCD_HEIGHT,
+						LCD_WIDTH * 2) != native) {
+			printf("FAIL zero-copy: %ux%u mode %s a panel-sized buffer through\n",
+			       mode->vwidth, mode->vheight,
+			       native ? "does not let" : "lets");
+			ret = -1;
+		}
+		spifb_scaler_free(&s);
+	}
+
+	spifb_pattern(img, LCD_WIDTH, LCD_HEIGHT, 4);
+	fb = spifb_image_convert(img, LCD_WIDTH, LCD_HEIGHT,
+				 NW_SPIFB_SRC_RGB565);
+	if (!fb || spifb_scaler_init(&s, &up, NW_SPIFB_FILTER_NEAREST))
+		goto fail;
+
+	src.base = (const uint8_t *)fb;
+	nw_spifb_scale_rows(&s.sc, &src, out, 0, LCD_HEIGHT, s.scratch);
+	spifb_scaler_free(&s);
+
+	spifb_emu_init(&emu);
+	if (capture)
+		spifb_capture_write(capture, out, sizeof(out));
+	if (spifb_emu_feed(&emu, out, sizeof(out))) {
+		printf("FAIL zero-copy: %s\n", emu.error);
+		goto fail;
+	}
+
+	for (y = 0; y < LCD_HEIGHT; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			uint16_t want = fb[y / 2 * LCD_WIDTH + x / 2];
+
+			if (be16toh(emu.lcd[y * LCD_WIDTH + x]) != want) {
+				printf("FAIL zero-copy: 160x120 LCD differs at (%u,%u)\n",
+				       x, y);
+				goto fail;
+			}
+		}
+	}
+
+	free(fb);
+	free(img);
+	return ret;
+
+fail:
+	free(fb);
+	free(img);
+	return -1;
+}
+
+/*
+ * Invert source rectangles and check every output pixel that changes
+ * lies inside the span-mapped rectangle the driver would send.
+ */
+static int check_span(const struct spifb_scaler *s, const uint32_t *img)
+{
+	const struct nw_spifb_scaler *sc = &s->sc;
+	uint32_t vw = sc->vwidth, vh = sc->vheight;
+	const uint32_t rects[][4] = {
+		{ 0, 0, 1, 1 },
+		{ vw - 1, vh - 1, vw, vh },
+		{ vw / 3, vh / 4, vw / 3 + 7, vh / 4 + 5 },
+		{ 5, 0, 6, vh },
+		{ 0, 10, vw, 11 },
+	};
+	size_t size = (size_t)vw * vh * 4;
+	uint32_t *mod = malloc(size);
+	static uint16_t a[LCD_PIXELS], b[LCD_PIXELS];
+	struct nw_spifb_src src = {
+		.pitch = vw * 4,
+		.format = NW_SPIFB_SRC_XRGB8888,
+	};
+	int ret = 0;
+	size_t r;
+
+	if (!mod)
+		return -1;
+
+	src.base = (const uint8_t *)img;
+	nw_spifb_scale_rows(sc, &src, a, 0, LCD_HEIGHT, s->scratch);
+
+	for (r = 0; r < ARRAY_SIZE(rects) && !ret; r++) {
+		const uint32_t *rc = rects[r];
+		uint32_t x0, y0, x1, y1, x, y;
+
+		memcpy(mod, img, size);
+		for (y = rc[1]; y < rc[3]; y++)
+			for (x = rc[0]; x < rc[2]; x++)
+				mod[y * vw + x] ^= 0x00ffffff;
+
+		src.base = (const uint8_t *)mod;
+		nw_spifb_scale_rows(sc, &src, b, 0, LCD_HEIGHT, s->scratch);
+
+		nw_spifb_scaler_span(rc[0], rc[2], vw, LCD_WIDTH, &x0, &x1);
+		nw_spifb_scaler_span(rc[1], rc[3], vh, LCD_HEIGHT, &y0, &y1);
+
+		for (y = 0; y < LCD_HEIGHT; y++)
+			for (x = 0; x < LCD_WIDTH; x++)
+				if (a[y * LCD_WIDTH + x] != b[y * LCD_WIDTH + x] &&
+				    (x < x0 || x >= x1 || y < y0 || y >= y1))
+					ret = -1;
+	}
+
+	free(mod);
+	return ret;
+}
+
+/*
+ * An 8-bit source must scale exactly like the XRGB8888 image its
+ * palette expands to, whichever way the kernels look colours up.
+ */
+static int check_palette(const struct spifb_scaler *s,
+			 const struct nw_spifb_src *c8, const uint16_t *want)
+{
+	const struct nw_spifb_scaler *sc = &s->sc;
+	size_t n = (size_t)sc->vwidth * sc->vheight, i;
+	uint32_t *img = malloc(n * 4);
+	static uint16_t out[LCD_PIXELS];
+	struct nw_spifb_src src = {
+		.base = (const uint8_t *)img,
+		.pitch = sc->vwidth * 4,
+		.format = NW_SPIFB_SRC_XRGB8888,
+	};
+	int ret;
+
+	if (!img)
+		return -1;
+
+	for (i = 0; i < n; i++)
+		img[i] = c8->palette->xrgb[c8->base[i]];
+
+	nw_spifb_scale_rows(sc, &src, out, 0, LCD_HEIGHT, s->scratch);
+	ret = memcmp(out, want, sizeof(out)) ? -1 : 0;
+
+	free(img);
+	return ret;
+}
+
+static uint32_t absdiff(uint32_t a, uint32_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+/* Largest per-channel difference between two big-endian RGB565 pixels */
+static uint32_t be565_diff(uint16_t a, uint16_t b)
+{
+	uint32_t r, g, bl;
+
+	a = be16toh(a);
+	b = be16toh(b);
+	r = absdiff(a >> 11, b >> 11);
+	g = absdiff(a >> 5 & 0x3f, b >> 5 & 0x3f);
+	bl = absdiff(a & 0x1f, b & 0x1f);
+
+	return r > g ? (r > bl ? r : bl) : (g > bl ? g : bl);
+}
+
+/*
+ * A cursor blended over nearest output must match the cursor drawn
+ * into the source before scaling: exactly where it is opaque or clear,
+ * within one RGB565 step where it is translucent. It is placed over
+ * the top-left corner, inside the frame and over the bottom-right one.
+ */
+static int check_cursor(const struct spifb_scaler *s, const uint32_t *img)
+{
+	const struct nw_spifb_scaler *sc = &s->sc;
+	int32_t vw = sc->vwidth, vh = sc->vheight;
+	const int32_t pos[][2] = {
+		{ -7, -9 },
+		{ vw / 2 - 5, vh / 3 },
+		{ vw - 20, vh - 11 },
+	};
+	static uint32_t argb[24 * 32];
+	static uint16_t want[LCD_PIXELS], got[LCD_PIXELS];
+	struct nw_spifb_cursor cur = {
+		.argb = argb,
+		.width = 24,	/* Not square, to catch swapped axes */
+		.height = 32,
+	};
+	size_t size = (size_t)vw * vh * 4;
+	uint32_t *mod = malloc(size);
+	struct nw_spifb_src src = {
+		.pitch = vw * 4,
+		.format = NW_SPIFB_SRC_XRGB8888,
+	};
+	int32_t x, y;
+	size_t n, i;
+	int ret = 0;
+
+	if (!mod)
+		return -1;
+
+	/* An opaque triangle over a translucent band, the rest clear */
+	for (y = 0; y < 32; y++) {
+		for (x = 0; x < 24; x++) {
+			uint32_t p = 0;
+
+			if (x <= y / 2)
+				p = 0xff000000 | x * 10 << 16 | y * 8;
+			else if (y >= 24)
+				p = 0x80402010;
+			argb[y * 24 + x] = p;
+		}
+	}
+
+	for (n = 0; n < ARRAY_SIZE(pos) && !ret; n++) {
+		cur.x = pos[n][0];
+		cur.y = pos[n][1];
+
+		/* Premultiplied "over", in the source */
+		memcpy(mod, img, size);
+		for (y = 0; y < 32; y++) {
+			for (x = 0; x < 24; x++) {
+				int32_t sx = cur.x + x, sy = cur.y + y;
+				uint32_t c = argb[y * 24 + x], ia = 255 - (c >> 24);
+				uint32_t *d = &mod[sy * vw + sx];
+				uint32_t out = 0xff000000;
+				int shift;
+
+				if (sx < 0 || sx >= vw || sy < 0 || sy >= vh)
+					continue;
+				for (shift = 0; shift < 24; shift += 8)
+					out |= ((c >> shift & 0xff) +
+						((*d >> shift & 0xff) * ia + 127) / 255)
+					       << shift;
+				*d = out;
+			}
+		}
+
+		src.base = (const uint8_t *)mod;
+		nw_spifb_scale_rows(sc, &src, want, 0, LCD_HEIGHT, s->scratch);
+		src.base = (const uint8_t *)img;
+		nw_spifb_scale_rows(sc, &src, got, 0, LCD_HEIGHT, s->scratch);
+		nw_spifb_blend_cursor(sc, &cur, got, 0, 0, LCD_WIDTH, LCD_HEIGHT);
+
+		for (i = 0; i < LCD_PIXELS; i++)
+			if (be565_diff(want[i], got[i]) > 1)
+				ret = -1;
+	}
+
+	free(mod);
+	return ret;
+}
+
+/* Overlay test image size, in luma pixels */
+#define OV_W	80
+#define OV_H	60
+
+/* Full-precision YCbCr -> 8-bit RGB, the reference for the kernel */
+static uint32_t yuv_ref(enum nw_spifb_yuv_matrix m, int y, int u, int v)
+{
+	int limited = m == NW_SPIFB_BT601_LIMITED || m == NW_SPIFB_BT709_LIMITED;
+	int bt709 = m == NW_SPIFB_BT709_LIMITED || m == NW_SPIFB_BT709_FULL;
+	double kr = bt709 ? 0.2126 : 0.299, kb = bt709 ? 0.0722 : 0.114;
+	double l = limited ? (y - 16) * 255.0 / 219 : y;
+	double d = (u - 128) * (limited ? 255.0 / 224 : 1);
+	double e = (v - 128) * (limited ? 255.0 / 224 : 1);
+	double rgb[3] = {
+		l + 2 * (1 - kr) * e,
+		l - (2 * kb * (1 - kb) * d + 2 * kr * (1 - kr) * e) / (1 - kr - kb),
+		l + 2 * (1 - kb) * d,
+	};
+	uint32_t out = 0xff000000;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		double c = rgb[i] < 0 ? 0 : rgb[i] > 255 ? 255 : rgb[i];
+
+		out |= (uint32_t)(c + 0.5) << (16 - 8 * i);
+	}
+	return out;
+}
+
+/*
+ * A YUV overlay drawn over nearest output must match the overlay drawn
+ * into the source before scaling, within one RGB565 step of rounding.
+ * A quarter of the image goes through NV12 and I420, upscaled 2x with
+ * a BT.601 limited-range matrix; all of it is downscaled 2x with a
+ * BT.709 full-range one, and its luma alone shown as greyscale.
+ */
+static int check_overlay(const struct spifb_scaler *s, const uint32_t *img)
+{
+	const struct nw_spifb_scaler *sc = &s->sc;
+	uint32_t vw = sc->vwidth, vh = sc->vheight;
+	static uint8_t luma[OV_W * OV_H], nv12[OV_W * OV_H / 2];
+	static uint8_t cb[OV_W * OV_H / 4], cr[OV_W * OV_H / 4];
+	static uint16_t want[LCD_PIXELS], got[LCD_PIXELS];
+	const struct {
+		enum nw_spifb_yuv_format format;
+		enum nw_spifb_yuv_matrix matrix;
+		uint32_t src_x, src_y, src_w, src_h;
+		uint32_t x, y, width, height;
+	} cases[] = {
+		{ NW_SPIFB_YUV_NV12, NW_SPIFB_BT601_LIMITED, 20, 14, OV_W / 2,
+		  OV_H / 2, vw / 4 + 1, vh / 5, OV_W, OV_H },
+		{ NW_SPIFB_YUV_I420, NW_SPIFB_BT601_LIMITED, 20, 14, OV_W / 2,
+		  OV_H / 2, vw / 4 + 1, vh / 5, OV_W, OV_H },
+		{ NW_SPIFB_YUV_NV12, NW_SPIFB_BT709_FULL, 0, 0, OV_W, OV_H,
+		  vw - OV_W / 2, vh - OV_H / 2, OV_W / 2, OV_H / 2 },
+		{ NW_SPIFB_YUV_GREY, NW_SPIFB_BT601_LIMITED, 0, 0, OV_W, OV_H,
+		  0, 7, OV_W, OV_H },
+	};
+	size_t size = (size_t)vw * vh * 4;
+	uint32_t *mod = malloc(size);
+	struct nw_spifb_src src = {
+		.pitch = vw * 4,
+		.format = NW_SPIFB_SRC_XRGB8888,
+	};
+	uint32_t x, y, x0, y0, x1, y1;
+	size_t n, i;
+	int ret = 0;
+
+	if (!mod)
+		return -1;
+
+	/* Luma ramps both ways, chroma cycling through the hues */
+	for (y = 0; y < OV_H; y++) {
+		for (x = 0; x < OV_W; x++) {
+			uint32_t c = (y / 2) * (OV_W / 2) + x / 2;
+
+			luma[y * OV_W + x] = 16 + (x * 3 + y * 2) % 220;
+			cb[c] = 28 + (x / 2 * 37) % 200;
+			cr[c] = 28 + (y / 2 * 53 + x / 2 * 11) % 200;
+		}
+	}
+	for (i = 0; i < OV_W * OV_H / 4; i++) {
+		nv12[2 * i] = cb[i];
+		nv12[2 * i + 1] = cr[i];
+	}
+
+	for (n = 0; n < ARRAY_SIZE(cases) && !ret; n++) {
+		bool semi = cases[n].format == NW_SPIFB_YUV_NV12;
+		struct nw_spifb_overlay ov = {
+			.plane = { luma, semi ? nv12 : cb, cr },
+			.pitch = { OV_W, semi ? OV_W : OV_W / 2, OV_W / 2 },
+			.format = cases[n].format,
+			.matrix = cases[n].matrix,
+			.src_x = cases[n].src_x,
+			.src_y = cases[n].src_y,
+			.src_w = cases[n].src_w,
+			.src_h = cases[n].src_h,
+			.x = cases[n].x,
+			.y = cases[n].y,
+			.width = cases[n].width,
+			.height = cases[n].height,
+		};
+
+		/* Sampled by nearest, straight into the source */
+		memcpy(mod, img, size);
+		for (y = 0; y < ov.height; y++) {
+			for (x = 0; x < ov.width; x++) {
+				uint32_t sx = ov.src_x + x * ov.src_w / ov.width;
+				uint32_t sy = ov.src_y + y * ov.src_h / ov.height;
+				uint32_t l = luma[sy * OV_W + sx];
+				uint32_t c = (sy / 2) * (OV_W / 2) + sx / 2;
+				uint32_t *d = &mod[(ov.y + y) * vw + ov.x + x];
+
+				if (ov.format == NW_SPIFB_YUV_GREY)
+					*d = 0xff000000 | l << 16 | l << 8 | l;
+				else
+					*d = yuv_ref(ov.matrix, l, cb[c], cr[c]);
+			}
+		}
+
+		src.base = (const uint8_t *)mod;
+		nw_spifb_scale_rows(sc, &src, want, 0, LCD_HEIGHT, s->scratch);
+		src.base = (const uint8_t *)img;
+		nw_spifb_scale_rows(sc, &src, got, 0, LCD_HEIGHT, s->scratch);
+		if (nw_spifb_overlay_span(sc, &ov, &x0, &y0, &x1, &y1))
+			nw_spifb_draw_overlay(sc, &ov, got, x0, y0, x1, y1);
+
+		for (i = 0; i < LCD_PIXELS; i++)
+			if (be565_diff(want[i], got[i]) > 1)
+				ret = -1;
+	}
+
+	free(mod);
+	return ret;
+}
+
+/* Pattern @index scaled 2:1 with the box filter */
+static int render(uint16_t *out, size_t index)
+{
+	const struct spifb_mode *mode = &spifb_modes[spifb_num_modes - 1];
+	uint32_t *img = malloc((size_t)mode->vwidth * mode->vheight * 4);
+	struct nw_spifb_src src = {
+		.base = (const uint8_t *)img,
+		.pitch = mode->vwidth * 4,
+		.format = NW_SPIFB_SRC_XRGB8888,
+	};
+	struct spifb_scaler s;
+
+	if (!img || spifb_scaler_init(&s, mode, NW_SPIFB_FILTER_BOX)) {
+		free(img);
+		return -1;
+	}
+
+	spifb_pattern(img, mode->vwidth, mode->vheight, index);
+	nw_spifb_scale_rows(&s.sc, &src, out, 0, LCD_HEIGHT, s.scratch);
+
+	spifb_scaler_free(&s);
+	free(img);
+	return 0;
+}
+
+/*
+ * Show frame @a as a v1 frame, then cut windows out of @b as v2
+ * messages, once per encoding. After each one the emulated LCD must
+ * match @a with every window so far replaced by @b, and every encoding
+ * must have been chosen at least once. Ends with a band of rows sent the
+ * way zero-copy sends them, and with field messages, which must only
+ * touch every other row and together cover their window.
+ */
+static int check_wire(const uint16_t *a, const uint16_t *b, FILE *capture)
+{
+	static const uint32_t windows[][4] = {
+		{ 0, 0, 1, 1 },			/* x, y, w, h */
+		{ LCD_WIDTH - 1, LCD_HEIGHT - 1, 1, 1 },
+		{ 17, 33, 120, 9 },		/* A line of terminal text */
+		{ 0, 100, LCD_WIDTH, 15 },	/* Full-width band */
+		{ 200, 0, 1, LCD_HEIGHT },
+		{ 17, 33, 120, 9 },		/* Unchanged: all-zero delta */
+		{ 0, 0, LCD_WIDTH, LCD_HEIGHT },
+		{ 0, 0, LCD_WIDTH, LCD_HEIGHT },
+	};
+	static struct spifb_emu emu;
+	static uint16_t ref[LCD_PIXELS];
+	uint8_t *msg = malloc(nw_spifb_wire_max_len(LCD_WIDTH, LCD_HEIGHT));
+	unsigned long used[NW_SPIFB_ENCODINGS] = { 0 };
+	int enc, ret = 0;
+	size_t i;
+
+	if (!msg)
+		return -1;
+
+	for (enc = NW_SPIFB_ENC_RAW; enc <= NW_SPIFB_ENC_XOR_RLE && !ret; enc++) {
+		spifb_emu_init(&emu);
+		memcpy(ref, a, sizeof(ref));
+		if (spifb_emu_feed(&emu, a, sizeof(ref)))
+			ret = -1;
+		if (capture)
+			spifb_capture_write(capture, a, sizeof(ref));
+
+		for (i = 0; i < ARRAY_SIZE(windows) && !ret; i++) {
+			const uint32_t *w = windows[i];
+			size_t len = nw_spifb_wire_encode(msg, b, ref, LCD_WIDTH,
+							  w[0], w[1], w[2], w[3],
+							  enc, false);
+			uint32_t y;
+
+			if (len > nw_spifb_wire_max_len(w[2], w[3])) {
+				printf("FAIL wire: encoding %d larger than raw\n", enc);
+				ret = -1;
+			}
+			used[((struct nw_spifb_wire_hdr *)msg)->encoding]++;
+
+			for (y = w[1]; y < w[1] + w[3]; y++)
+				memcpy(&ref[y * LCD_WIDTH + w[0]],
+				       &b[y * LCD_WIDTH + w[0]], w[2] * 2);
+
+			if (capture)
+				spifb_capture_write(capture, msg, len);
+			if (spifb_emu_feed(&emu, msg, len)) {
+				printf("FAIL wire: %s\n", emu.error);
+				ret = -1;
+			} else if (memcmp(emu.lcd, ref, sizeof(ref))) {
+				ret = -1;
+			}
+		}
+	}
+
+	/* Zero-copy sends: whole rows of native little-endian RGB565 */
+	if (!ret) {
+		struct nw_spifb_wire_hdr *hdr = (struct nw_spifb_wire_hdr *)msg;
+		uint16_t *px = (uint16_t *)(hdr + 1);
+		const uint32_t y0 = 50, rows = 20;
+		uint32_t len = rows * LCD_WIDTH * 2, n;
+
+		for (n = 0; n < rows * LCD_WIDTH; n++)
+			px[n] = htole16(be16toh(b[y0 * LCD_WIDTH + n]));
+		nw_spifb_wire_hdr_init(hdr, NW_SPIFB_ENC_RAW_LE, 0, y0,
+				       LCD_WIDTH, rows, len);
+		memcpy(&ref[y0 * LCD_WIDTH], &b[y0 * LCD_WIDTH], len);
+
+		if (capture)
+			spifb_capture_write(capture, msg, sizeof(*hdr) + len);
+		if (spifb_emu_feed(&emu, msg, sizeof(*hdr) + len)) {
+			printf("FAIL wire: %s\n", emu.error);
+			ret = -1;
+		} else if (memcmp(emu.lcd, ref, sizeof(ref))) {
+			printf("FAIL wire: little-endian rows differ\n");
+			ret = -1;
+		}
+	}
+
+	/* Field messages: rows y, y + 2, ... of their window only */
+	for (enc = NW_SPIFB_ENC_RAW; enc <= NW_SPIFB_ENC_XOR_RLE && !ret; enc++) {
+		static const uint32_t fields[][4] = {
+			{ 17, 33, 120, 5 },	/* Odd rows of the text line */
+			{ 17, 34, 120, 4 },	/* ...then its even rows */
+			{ 0, 0, LCD_WIDTH, LCD_HEIGHT / 2 },
+			{ 0, 1, LCD_WIDTH, LCD_HEIGHT / 2 },
+		};
+		struct nw_spifb_wire_hdr *hdr = (struct nw_spifb_wire_hdr *)msg;
+
+		spifb_emu_init(&emu);
+		memcpy(ref, a, sizeof(ref));
+		spifb_emu_feed(&emu, a, sizeof(ref));
+		if (capture)
+			spifb_capture_write(capture, a, sizeof(ref));
+
+		for (i = 0; i < ARRAY_SIZE(fields) && !ret; i++) {
+			const uint32_t *w = fields[i];
+			size_t len = nw_spifb_wire_encode(msg, b, ref, LCD_WIDTH,
+							  w[0], w[1], w[2], w[3],
+							  enc, true);
+			uint32_t y;
+
+			for (y = w[1]; y < w[1] + 2 * w[3]; y += 2)
+				memcpy(&ref[y * LCD_WIDTH + w[0]],
+				       &b[y * LCD_WIDTH + w[0]], w[2] * 2);
+
+			if (capture)
+				spifb_capture_write(capture, msg, len);
+			if (spifb_emu_feed(&emu, msg, len)) {
+				printf("FAIL wire: field: %s\n", emu.error);
+				ret = -1;
+			} else if (memcmp(emu.lcd, ref, sizeof(ref))) {
+				printf("FAIL wire: field %zu, encoding %d differs\n",
+				       i, enc);
+				ret = -1;
+			}
+		}
+
+		if (!ret && (emu.fields != ARRAY_SIZE(fields) ||
+			     memcmp(emu.lcd, b, sizeof(ref)))) {
+			printf("FAIL wire: fields did not converge\n");
+			ret = -1;
+		}
+
+		/* One row too many for the LCD: rejected */
+		nw_spifb_wire_hdr_init(hdr, NW_SPIFB_ENC_RAW, 0, LCD_HEIGHT - 2,
+				       1, 2, 4);
+		hdr->encoding |= NW_SPIFB_WIRE_FIELD;
+		if (!ret && !spifb_emu_feed(&emu, msg, sizeof(*hdr) + 4)) {
+			printf("FAIL wire: field past the last row accepted\n");
+			ret = -1;
+		}
+	}
+
+	for (enc = NW_SPIFB_ENC_RAW; enc <= NW_SPIFB_ENC_XOR_RLE && !ret; enc++) {
+		if (!used[enc]) {
+			printf("FAIL wire: encoding %d never chosen\n", enc);
+			ret = -1;
+		}
+	}
+
+	free(msg);
+	return ret;
+}
+
+/* RGB565 channel value @v rounded to the nearest of the slave's levels */
+static uint32_t rgb332_nearest(uint32_t v, uint32_t shift, uint32_t mask)
+{
+	uint32_t best = 0, c;
+
+	/* Walk every RGB332 value of the channel, ties go up */
+	for (c = 0; c < 256; c++) {
+		uint32_t l = (nw_spifb_rgb332_to_rgb565(c) >> shift) & mask;
+		uint32_t b = (nw_spifb_rgb332_to_rgb565(best) >> shift) & mask;
+
+		if (abs((int)l - (int)v) <= abs((int)b - (int)v))
+			best = c;
+	}
+	return (nw_spifb_rgb332_to_rgb565(best) >> shift) & mask;
+}
+
+/*
+ * Send frames as RGB332 messages through the slave emulator. Every
+ * colour RGB332 can show must come through unchanged, dithered or not.
+ * Undithered, @img must come back with each channel at its nearest
+ * level, also as a field. Dithered, a flat colour between levels must
+ * average out to itself, within a sixteenth of a level.
+ */
+static int check_rgb332(const uint16_t *img)
+{
+	static const uint32_t shifts[3] = { 11, 5, 0 }, masks[3] = { 31, 63, 31 };
+	static struct spifb_emu emu;
+	static uint16_t frame[LCD_PIXELS], want[LCD_PIXELS];
+	uint8_t *msg = malloc(nw_spifb_wire_max_len(LCD_WIDTH, LCD_HEIGHT));
+	const uint16_t flat = 10 << 11 | 20 << 5 | 7;	/* Between levels */
+	uint32_t i, ch, sum[3] = { 0 }, y;
+	int dither, ret = 0;
+	size_t len;
+
+	if (!msg)
+		return -1;
+
+	for (i = 0; i < LCD_PIXELS; i++)
+		frame[i] = htobe16(nw_spifb_rgb332_to_rgb565(i * 7 & 0xff));
+
+	for (dither = 0; dither <= 1 && !ret; dither++) {
+		spifb_emu_init(&emu);
+		len = nw_spifb_wire_encode_rgb332(msg, frame, LCD_WIDTH, 0, 0,
+						  LCD_WIDTH, LCD_HEIGHT, false,
+						  dither);
+		if (len != sizeof(struct nw_spifb_wire_hdr) + LCD_PIXELS ||
+		    spifb_emu_feed(&emu, msg, len) ||
+		    memcmp(emu.lcd, frame, sizeof(frame))) {
+			printf("FAIL rgb332: RGB332 colours changed (dither %d)\n",
+			       dither);
+			ret = -1;
+		}
+	}
+
+	/* Nearest levels, then the same again over every other row */
+	for (i = 0; i < LCD_PIXELS && !ret; i++) {
+		uint16_t p = be16toh(img[i]);
+
+		want[i] = 0;
+		for (ch = 0; ch < 3; ch++)
+			want[i] |= rgb332_nearest(p >> shifts[ch] & masks[ch],
+						  shifts[ch], masks[ch]) << shifts[ch];
+		want[i] = htobe16(want[i]);
+	}
+	if (!ret) {
+		spifb_emu_init(&emu);
+		len = nw_spifb_wire_encode_rgb332(msg, img, LCD_WIDTH, 0, 0,
+						  LCD_WIDTH, LCD_HEIGHT, false,
+						  false);
+		if (spifb_emu_feed(&emu, msg, len) ||
+		    memcmp(emu.lcd, want, sizeof(want))) {
+			printf("FAIL rgb332: not rounded to the nearest level\n");
+			ret = -1;
+		}
+
+		/* Rows 33, 35, ... 41 of a text line, on a blank LCD */
+		memcpy(frame, want, sizeof(frame));
+		memset(want, 0, sizeof(want));
+		for (y = 33; y < 43; y += 2)
+			memcpy(&want[y * LCD_WIDTH + 17],
+			       &frame[y * LCD_WIDTH + 17], 120 * 2);
+		spifb_emu_init(&emu);
+		len = nw_spifb_wire_encode_rgb332(msg, img, LCD_WIDTH, 17, 33,
+						  120, 5, true, false);
+		spifb_emu_feed(&emu, msg, len);
+		if (!ret && (emu.fields != 1 ||
+			     memcmp(emu.lcd, want, sizeof(want)))) {
+			printf("FAIL rgb332: field rows differ\n");
+			ret = -1;
+		}
+	}
+
+	for (i = 0; i < LCD_PIXELS; i++)
+		frame[i] = htobe16(flat);
+	spifb_emu_init(&emu);
+	len = nw_spifb_wire_encode_rgb332(msg, frame, LCD_WIDTH, 0, 0,
+					  LCD_WIDTH, LCD_HEIGHT, false, true);
+	spifb_emu_feed(&emu, msg, len);
+	for (i = 0; i < LCD_PIXELS; i++)
+		for (ch = 0; ch < 3; ch++)
+			sum[ch] += be16toh(emu.lcd[i]) >> shifts[ch] & masks[ch];
+	for (ch = 0; ch < 3 && !ret; ch++) {
+		/* Levels are at most 11 apart: a sixteenth is under 3/4 */
+		uint32_t v = flat >> shifts[ch] & masks[ch];
+
+		if (abs((int)(sum[ch] - v * LCD_PIXELS)) > LCD_PIXELS * 3 / 4) {
+			printf("FAIL rgb332: dithered channel %u averages %.2f, not %u\n",
+			       ch, (double)sum[ch] / LCD_PIXELS, v);
+			ret = -1;
+		}
+	}
+
+	free(msg);
+	return ret;
+}
+
+/*
+ * Feed the histogram a known sequence and compare its summary with
+ * what nearest-rank percentiles of the retained window must be.
+ */
+static int check_hist(void)
+{
+	static const struct {
+		uint32_t samples;	/* Durations 1..samples us, in order */
+		struct nw_spifb_hist_summary want;
+	} cases[] = {
+		{ 0, { 0, 0, 0, 0 } },
+		{ 1, { 1, 1, 1, 1 } },
+		{ 10, { 10, 5, 10, 10 } },
+		{ 200, { 200, 100, 198, 200 } },
+		/* Only the last 256 are kept: 745..1000 */
+		{ 1000, { NW_SPIFB_HIST_LEN, 872, 998, 1000 } },
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(cases); i++) {
+		static struct nw_spifb_hist hist;
+		struct nw_spifb_hist_summary sum;
+		uint32_t n;
+
+		memset(&hist, 0, sizeof(hist));
+		/* Sub-microsecond remainders are truncated */
+		for (n = 1; n <= cases[i].samples; n++)
+			nw_spifb_hist_add(&hist, (uint64_t)n * 1000 + 999);
+
+		nw_spifb_hist_summarize(&hist, &sum);
+		if (memcmp(&sum, &cases[i].want, sizeof(sum))) {
+			printf("FAIL hist %u: samples %u p50 %u p99 %u max %u\n",
+			       cases[i].samples, sum.samples, sum.p50, sum.p99,
+			       sum.max);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Gamma-like curve that lifts the shadows, or the identity */
+static double colour_curve(double v, int curve)
+{
+	return curve ? v * (2 - v) : v;
+}
+
+/*
+ * Colour tables against the same colour management done in floating
+ * point, within one RGB565 step: the identity, a night-light gamma
+ * curve, and a channel-mixing matrix. The table must also only be
+ * applied inside the rectangle it is given.
+ */
+static int check_colour(void)
+{
+	static const double ctm[][9] = {
+		{ 1, 0, 0, 0, 1, 0, 0, 0, 1 },
+		{ 1, 0, 0, 0, 1, 0, 0, 0, 1 },
+		{ 0, 0, 1, 0.5, 0.5, 0, 0.25, 0.25, 0.25 },
+	};
+	static struct nw_spifb_colour colour;
+	static uint16_t table[NW_SPIFB_COLOUR_TABLE_LEN];
+	static uint16_t out[LCD_PIXELS];
+	struct nw_spifb_scaler sc = { .width = LCD_WIDTH, .height = LCD_HEIGHT };
+	size_t i, c;
+	uint32_t ch, j, x, y;
+
+	for (c = 0; c < ARRAY_SIZE(ctm); c++) {
+		double gain[3] = { 1, 1, 1 };
+		int curve = c == 1;
+
+		/* Night light: warmer, and a brightening curve on top */
+		if (curve) {
+			gain[1] = 0.8;
+			gain[2] = 0.5;
+		}
+
+		nw_spifb_colour_identity(&colour);
+		for (ch = 0; ch < 3; ch++)
+			for (j = 0; j < NW_SPIFB_COLOUR_LUT_LEN; j++)
+				colour.gamma[ch][j] = 0xffff * gain[ch] *
+					colour_curve(j / 255.0, curve) + 0.5;
+		for (j = 0; j < 9; j++)
+			colour.ctm[j] = ctm[c][j] * 0x10000;
+
+		if (nw_spifb_colour_table(table, &colour) != (c != 0)) {
+			printf("FAIL colour %zu: identity not detected\n", c);
+			return -1;
+		}
+
+		for (i = 0; i < NW_SPIFB_COLOUR_TABLE_LEN; i++) {
+			uint32_t p = be16toh(i);
+			double in[3] = {
+				((p >> 11) << 3 | p >> 13) / 255.0,
+				((p >> 5 & 0x3f) << 2 | (p >> 9 & 3)) / 255.0,
+				((p & 0x1f) << 3 | (p >> 2 & 7)) / 255.0,
+			};
+			uint16_t want;
+			uint32_t q[3];
+
+			for (ch = 0; ch < 3; ch++) {
+				const double *m = &ctm[c][3 * ch];
+				double v = m[0] * in[0] + m[1] * in[1] + m[2] * in[2];
+
+				v = v < 0 ? 0 : v > 1 ? 1 : v;
+				v = gain[ch] * colour_curve(v, curve);
+				q[ch] = v * (ch == 1 ? 63 : 31) + 0.5;
+			}
+			want = htobe16(q[0] << 11 | q[1] << 5 | q[2]);
+			if (be565_diff(table[i], want) > 1) {
+				printf("FAIL colour %zu: %04x -> %04x, want %04x\n",
+				       c, p, be16toh(table[i]), be16toh(want));
+				return -1;
+			}
+		}
+	}
+
+	/* The last table, over a rectangle of a frame of every value */
+	for (i = 0; i < LCD_PIXELS; i++)
+		out[i] = i * 7;
+	nw_spifb_colour_rect(&sc, table, out, 10, 20, 301, 221);
+	for (y = 0; y < LCD_HEIGHT; y++) {
+		for (x = 0; x < LCD_WIDTH; x++) {
+			uint16_t v = (y * LCD_WIDTH + x) * 7;
+
+			if (x >= 10 && x < 301 && y >= 20 && y < 221)
+				v = table[v];
+			if (out[y * LCD_WIDTH + x] != v) {
+				printf("FAIL colour rect: (%u,%u) %04x, want %04x\n",
+				       x, y, out[y * LCD_WIDTH + x], v);
+				return -1;
+			}
+		}
+	}
+
+	/*
+	 * Interpolation between gamma entries. Degamma squeezes every input
+	 * into the segment between entries 127 and 128, and gamma climbs
+	 * 0xf0f0 across that one segment, so the exact output is the whole
+	 * number base + 240 * in. Any bias in the interpolation is below a
+	 * RGB565 step, so sweep base until exact outputs sit on rounding
+	 * thresholds, and demand exact results.
+	 */
+	for (c = 0; c < 256; c++) {
+		nw_spifb_colour_identity(&colour);
+		for (ch = 0; ch < 3; ch++) {
+			for (j = 0; j < NW_SPIFB_COLOUR_LUT_LEN; j++) {
+				colour.degamma[ch][j] = 127 * 257 + j;
+				colour.gamma[ch][j] = c + (j < 128 ? 0 : 0xf0f0);
+			}
+		}
+		nw_spifb_colour_table(table, &colour);
+
+		for (i = 0; i < NW_SPIFB_COLOUR_TABLE_LEN; i++) {
+			uint32_t p = be16toh(i);
+			uint32_t in[3] = {
+				(p >> 11) << 3 | p >> 13,
+				(p >> 5 & 0x3f) << 2 | (p >> 9 & 3),
+				(p & 0x1f) << 3 | (p >> 2 & 7),
+			};
+			uint32_t q[3];
+			uint16_t want;
+
+			for (ch = 0; ch < 3; ch++)
+				q[ch] = ((c + 240 * in[ch]) * (ch == 1 ? 63 : 31) +
+					 0x7fff) / 0xffff;
+			want = htobe16(q[0] << 11 | q[1] << 5 | q[2]);
+			if (table[i] != want) {
+				printf("FAIL colour steep %zu: %04x -> %04x, want %04x\n",
+				       c, p, be16toh(table[i]), be16toh(want));
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *golden_path = "golden.txt";
+	const char *dump_dir = NULL;
+	FILE *capture = NULL;
+	static uint16_t out[LCD_PIXELS], prev[LCD_PIXELS];
+	FILE *update = NULL;
+	int failed = 0, total = 0;
+	size_t m, p;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ug:d:c:")) != -1) {
+		switch (opt) {
+		case 'u':
+			update = stdout;
+			break;
+		case 'g':
+			golden_path = optarg;
+			break;
+		case 'd':
+			dump_dir = optarg;
+			break;
+		case 'c':
+			capture = fopen(optarg, "wb");
+			if (!capture) {
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-u] [-g golden.txt] [-d dumpdir] [-c capture.bin]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	if (update) {
+		update = fopen(golden_path, "w");
+		if (!update) {
+			perror(golden_path);
+			return 1;
+		}
+		fprintf(update, "# drm-spifb pixel kernel golden CRC32s, generated by spifb-test -u\n");
+	} else if (load_golden(golden_path)) {
+		perror(golden_path);
+		return 1;
+	}
+
+	for (m = 0; m < spifb_num_modes; m++) {
+		const struct spifb_mode *mode = &spifb_modes[m];
+		uint32_t *img = malloc((size_t)mode->vwidth * mode->vheight * 4);
+
+		if (!img)
+			return 1;
+
+		for (p = 0; p < spifb_num_patterns; p++) {
+			int fmt, filt;
+
+			spifb_pattern(img, mode->vwidth, mode->vheight, p);
+
+			for (fmt = NW_SPIFB_SRC_XRGB8888; fmt <= NW_SPIFB_SRC_C8; fmt++) {
+				void *pixels = spifb_image_convert(img, mode->vwidth,
+								   mode->vheight, fmt);
+				struct nw_spifb_src src = {
+					.base = pixels,
+					.pitch = mode->vwidth * spifb_format_cpp(fmt),
+					.format = fmt,
+					.palette = spifb_format_palette(fmt),
+				};
+
+				if (!pixels)
+					return 1;
+
+				for (filt = NW_SPIFB_FILTER_NEAREST; filt <= NW_SPIFB_FILTER_BOX; filt++) {
+					const struct golden *g;
+					struct spifb_scaler s;
+					char name[64];
+					uint32_t crc;
+
+					snprintf(name, sizeof(name), "%s-%ux%u-%s-%s",
+						 spifb_format_name(fmt), mode->vwidth,
+						 mode->vheight, spifb_filter_name(filt),
+						 spifb_pattern_names[p]);
+
+					if (spifb_scaler_init(&s, mode, filt))
+						return 1;
+
+					memset(out, 0, sizeof(out));
+					nw_spifb_scale_rows(&s.sc, &src, out, 0,
+							    LCD_HEIGHT, s.scratch);
+					crc = spifb_crc32(out, sizeof(out));
+					total++;
+
+					if (dump_dir) {
+						char path[256];
+
+						snprintf(path, sizeof(path), "%s/%s.ppm",
+							 dump_dir, name);
+						if (spifb_write_ppm(path, out, LCD_WIDTH,
+								    LCD_HEIGHT))
+							perror(path);
+					}
+
+					if (check_bands(&s, &src, out)) {
+						printf("FAIL %s: banded output differs\n", name);
+						failed++;
+					}
+
+					if (check_rects(&s, &src, out)) {
+						printf("FAIL %s: partial output differs\n", name);
+						failed++;
+					}
+
+					/* Once per mode and filter is plenty */
+					if (fmt == NW_SPIFB_SRC_XRGB8888 &&
+					    !strcmp(spifb_pattern_names[p], "noise")) {
+						total++;
+						if (check_span(&s, img)) {
+							printf("FAIL %s: change outside span\n",
+							       name);
+							failed++;
+						}
+					}
+
+					if (fmt == NW_SPIFB_SRC_XRGB8888 &&
+					    filt == NW_SPIFB_FILTER_NEAREST &&
+					    !strcmp(spifb_pattern_names[p], "noise")) {
+						total++;
+						if (check_nearest(&s, img, out)) {
+							printf("FAIL %s: not the nearest source pixel\n",
+							       name);
+							failed++;
+						}
+					}
+
+					if (fmt == NW_SPIFB_SRC_XRGB8888 &&
+					    filt == NW_SPIFB_FILTER_NEAREST &&
+					    !strcmp(spifb_pattern_names[p], "noise")) {
+						total++;
+						if (check_cursor(&s, img)) {
+							printf("FAIL %s: cursor blend differs\n",
+							       name);
+							failed++;
+						}
+						total++;
+						if (check_overlay(&s, img)) {
+							printf("FAIL %s: overlay differs\n",
+							       name);
+							failed++;
+						}
+					}
+
+					if (fmt == NW_SPIFB_SRC_C8 &&
+					    !strcmp(spifb_pattern_names[p], "noise")) {
+						total++;
+						if (check_palette(&s, &src, out)) {
+							printf("FAIL %s: palette lookup differs\n",
+							       name);
+							failed++;
+						}
+					}
+
+					if (update) {
+						fprintf(update, "%s %08x\n", name, crc);
+					} else if (!(g = find_golden(name))) {
+						printf("FAIL %s: no golden value\n", name);
+						failed++;
+					} else if (g->crc != crc) {
+						printf("FAIL %s: crc %08x, golden %08x\n",
+						       name, crc, g->crc);
+						failed++;
+					}
+
+					spifb_scaler_free(&s);
+				}
+				free(pixels);
+			}
+		}
+		free(img);
+	}
+
+	/* Noise, then text: compresses well, but not as a delta on noise */
+	total++;
+	if (render(prev, 4) || render(out, 3) || check_wire(prev, out, capture)) {
+		printf("FAIL wire: emulated LCD differs\n");
+		failed++;
+	}
+
+	total++;
+	if (check_rgb332(out))
+		failed++;
+
+	total++;
+	if (check_zero_copy(capture))
+		failed++;
+	if (capture)
+		fclose(capture);
+
+	total++;
+	if (check_hist())
+		failed++;
+
+	total++;
+	if (check_colour())
+		failed++;
+
+	if (update) {
+		fclose(update);
+		printf("wrote %d golden values to %s\n", total, golden_path);
+		return failed ? 1 : 0;
+	}
+
+	printf("%d/%d cases passed%s\n", total - failed, total,
+#ifdef NW_SPIFB_HAVE_NEON
+	       " (NEON)"
+#else
+	       " (scalar)"
+#endif
+	       );
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,493 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * spifb-viewfinder - show a V4L2 capture on the drm-spifb overlay plane
+ *
+ * Captures NV12, YUV420 or greyscale frames from a V4L2 device and puts
+ * each one on the driver's YUV overlay plane, scaled to fit the current
+ * mode. The driver converts and scales it in its own pass, so no
+ * compositor or GPU is involved. Frames are copied into three DRM dumb
+ * buffers in turn; each SETPLANE returns at the next emulated vblank,
+ * which paces the loop to the bus.
+ *
+ * The vivid virtual V4L2 driver ('modprobe vivid') makes a test source
+ * on any machine; a camera works the same through its V4L2 node.
+ * SETPLANE needs DRM master, so run it from the console or with the
+ * compositor stopped.
+ *
+ * Usage: spifb-viewfinder [-v /dev/videoN] [-d /dev/dri/cardN]
+ *                         [-f nv12|yuv420|grey] [-s WxH] [-n frames]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+
+/* From <drm/drm_mode.h> and <drm/drm.h>, to avoid depending on libdrm headers */
+struct drm_set_client_cap {
+	uint64_t capability;
+	uint64_t value;
+};
+
+struct drm_mode_modeinfo {
+	uint32_t clock;
+	uint16_t hdisplay, hsync_start, hsync_end, htotal, hskew;
+	uint16_t vdisplay, vsync_start, vsync_end, vtotal, vscan;
+	uint32_t vrefresh;
+	uint32_t flags;
+	uint32_t type;
+	char name[32];
+};
+
+struct drm_mode_card_res {
+	uint64_t fb_id_ptr;
+	uint64_t crtc_id_ptr;
+	uint64_t connector_id_ptr;
+	uint64_t encoder_id_ptr;
+	uint32_t count_fbs;
+	uint32_t count_crtcs;
+	uint32_t count_connectors;
+	uint32_t count_encoders;
+	uint32_t min_width, max_width;
+	uint32_t min_height, max_height;
+};
+
+struct drm_mode_crtc {
+	uint64_t set_connectors_ptr;
+	uint32_t count_connectors;
+	uint32_t crtc_id;
+	uint32_t fb_id;
+	uint32_t x, y;
+	uint32_t gamma_size;
+	uint32_t mode_valid;
+	struct drm_mode_modeinfo mode;
+};
+
+struct drm_mode_get_plane_res {
+	uint64_t plane_id_ptr;
+	uint32_t count_planes;
+};
+
+struct drm_mode_get_plane {
+	uint32_t plane_id;
+	uint32_t crtc_id;
+	uint32_t fb_id;
+	uint32_t possible_crtcs;
+	uint32_t gamma_size;
+	uint32_t count_format_types;
+	uint64_t format_type_ptr;
+};
+
+struct drm_mode_set_plane {
+	uint32_t plane_id;
+	uint32_t crtc_id;
+	uint32_t fb_id;
+	uint32_t flags;
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+	uint32_t src_x, src_y;
+	uint32_t src_h, src_w;		/* Sic: height first */
+};
+
+struct drm_mode_create_dumb {
+	uint32_t height;
+	uint32_t width;
+	uint32_t bpp;
+	uint32_t flags;
+	uint32_t handle;
+	uint32_t pitch;
+	uint64_t size;
+};
+
+struct drm_mode_map_dumb {
+	uint32_t handle;
+	uint32_t pad;
+	uint64_t offset;
+};
+
+struct drm_mode_fb_cmd2 {
+	uint32_t fb_id;
+	uint32_t width, height;
+	uint32_t pixel_format;
+	uint32_t flags;
+	uint32_t handles[4];
+	uint32_t pitches[4];
+	uint32_t offsets[4];
+	uint64_t modifier[4];
+};
+
+#define DRM_IOCTL_SET_CLIENT_CAP	_IOW('d', 0x0d, struct drm_set_client_cap)
+#define DRM_IOCTL_MODE_GETRESOURCES	_IOWR('d', 0xA0, struct drm_mode_card_res)
+#define DRM_IOCTL_MODE_GETCRTC		_IOWR('d', 0xA1, struct drm_mode_crtc)
+#define DRM_IOCTL_MODE_RMFB		_IOWR('d', 0xAF, unsigned int)
+#define DRM_IOCTL_MODE_CREATE_DUMB	_IOWR('d', 0xB2, struct drm_mode_create_dumb)
+#define DRM_IOCTL_MODE_MAP_DUMB		_IOWR('d', 0xB3, struct drm_mode_map_dumb)
+#define DRM_IOCTL_MODE_GETPLANERESOURCES _IOWR('d', 0xB5, struct drm_mode_get_plane_res)
+#define DRM_IOCTL_MODE_GETPLANE		_IOWR('d', 0xB6, struct drm_mode_get_plane)
+#define DRM_IOCTL_MODE_SETPLANE		_IOWR('d', 0xB7, struct drm_mode_set_plane)
+#define DRM_IOCTL_MODE_ADDFB2		_IOWR('d', 0xB8, struct drm_mode_fb_cmd2)
+
+#define DRM_CLIENT_CAP_UNIVERSAL_PLANES	2
+
+#define fourcc(a, b, c, d)	((uint32_t)(a) | (uint32_t)(b) << 8 | \
+				 (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+#define NUM_FBS		3
+#define NUM_CAPTURE	4
+
+struct format {
+	const char *name;
+	uint32_t v4l2;
+	uint32_t drm;
+};
+
+/* V4L2 and DRM fourccs of the same layouts */
+static const struct format formats[] = {
+	{ "nv12",   V4L2_PIX_FMT_NV12,   fourcc('N', 'V', '1', '2') },
+	{ "yuv420", V4L2_PIX_FMT_YUV420, fourcc('Y', 'U', '1', '2') },
+	{ "grey",   V4L2_PIX_FMT_GREY,   fourcc('R', '8', ' ', ' ') },
+};
+
+struct fb {
+	uint32_t id;
+	uint8_t *map;
+	uint32_t pitches[3];
+	uint32_t offsets[3];
+};
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* First CRTC, which must be showing a mode, and a plane on it taking NV12 */
+static int find_overlay(int fd, uint32_t *crtc_id, uint32_t *plane_id,
+			uint32_t *mode_w, uint32_t *mode_h)
+{
+	struct drm_set_client_cap cap = { DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1 };
+	struct drm_mode_card_res res = { 0 };
+	struct drm_mode_get_plane_res pres = { 0 };
+	struct drm_mode_crtc crtc = { 0 };
+	uint32_t crtcs[4], planes[16], fmts[32];
+	uint32_t i, j;
+
+	if (ioctl(fd, DRM_IOCTL_SET_CLIENT_CAP, &cap) ||
+	    ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res))
+		return -errno;
+	if (!res.count_crtcs)
+		return -ENODEV;
+
+	memset(&res, 0, sizeof(res));
+	res.crtc_id_ptr = (uintptr_t)crtcs;
+	res.count_crtcs = 1;
+	if (ioctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res))
+		return -errno;
+
+	crtc.crtc_id = crtcs[0];
+	if (ioctl(fd, DRM_IOCTL_MODE_GETCRTC, &crtc))
+		return -errno;
+	if (!crtc.mode_valid)
+		return -ENOLINK;
+	*crtc_id = crtc.crtc_id;
+	*mode_w = crtc.mode.hdisplay;
+	*mode_h = crtc.mode.vdisplay;
+
+	pres.plane_id_ptr = (uintptr_t)planes;
+	pres.count_planes = ARRAY_SIZE(planes);
+	if (ioctl(fd, DRM_IOCTL_MODE_GETPLANERESOURCES, &pres))
+		return -errno;
+
+	for (i = 0; i < pres.count_planes && i < ARRAY_SIZE(planes); i++) {
+		struct drm_mode_get_plane plane = {
+			.plane_id = planes[i],
+			.count_format_types = ARRAY_SIZE(fmts),
+			.format_type_ptr = (uintptr_t)fmts,
+		};
+
+		if (ioctl(fd, DRM_IOCTL_MODE_GETPLANE, &plane) ||
+		    !(plane.possible_crtcs & 1))
+			continue;
+		for (j = 0; j < plane.count_format_types && j < ARRAY_SIZE(fmts); j++) {
+			if (fmts[j] == formats[0].drm) {
+				*plane_id = planes[i];
+				return 0;
+			}
+		}
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * A dumb buffer holding a w x h frame of @f, its planes laid out one
+ * after the other as V4L2 lays out single-buffer captures.
+ */
+static int fb_create(int fd, const struct format *f, uint32_t w, uint32_t h,
+		     struct fb *fb)
+{
+	struct drm_mode_create_dumb create = {
+		.width = w,
+		.height = f->v4l2 == V4L2_PIX_FMT_GREY ? h : h * 3 / 2,
+		.bpp = 8,
+	};
+	struct drm_mode_map_dumb map = { 0 };
+	struct drm_mode_fb_cmd2 cmd = {
+		.width = w,
+		.height = h,
+		.pixel_format = f->drm,
+	};
+	int i, planes = 1;
+	void *p;
+
+	if (ioctl(fd, DRM_IOCTL_MODE_CREATE_DUMB, &create))
+		return -errno;
+	map.handle = create.handle;
+	if (ioctl(fd, DRM_IOCTL_MODE_MAP_DUMB, &map))
+		return -errno;
+	p = mmap(NULL, create.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		 map.offset);
+	if (p == MAP_FAILED)
+		return -errno;
+	fb->map = p;
+
+	fb->pitches[0] = create.pitch;
+	fb->offsets[0] = 0;
+	if (f->v4l2 == V4L2_PIX_FMT_NV12) {
+		fb->pitches[1] = create.pitch;
+		fb->offsets[1] = create.pitch * h;
+		planes = 2;
+	} else if (f->v4l2 == V4L2_PIX_FMT_YUV420) {
+		fb->pitches[1] = fb->pitches[2] = create.pitch / 2;
+		fb->offsets[1] = create.pitch * h;
+		fb->offsets[2] = fb->offsets[1] + create.pitch / 2 * h / 2;
+		planes = 3;
+	}
+
+	for (i = 0; i < planes; i++) {
+		cmd.handles[i] = create.handle;
+		cmd.pitches[i] = fb->pitches[i];
+		cmd.offsets[i] = fb->offsets[i];
+	}
+	if (ioctl(fd, DRM_IOCTL_MODE_ADDFB2, &cmd))
+		return -errno;
+	fb->id = cmd.fb_id;
+
+	return 0;
+}
+
+/* Copy a capture with Y rows @bpl bytes apart into @fb, plane by plane */
+static void fb_fill(const struct fb *fb, const struct format *f,
+		    const uint8_t *src, uint32_t bpl, uint32_t w, uint32_t h)
+{
+	uint32_t rows[3] = { h, h / 2, h / 2 };
+	uint32_t src_pitch[3] = { bpl, bpl, bpl / 2 };
+	uint32_t len[3] = { w, w, w / 2 };
+	int i, planes = 1;
+	uint32_t y;
+
+	if (f->v4l2 == V4L2_PIX_FMT_NV12) {
+		planes = 2;
+	} else if (f->v4l2 == V4L2_PIX_FMT_YUV420) {
+		src_pitch[1] = src_pitch[2] = bpl / 2;
+		len[1] = w / 2;
+		planes = 3;
+	}
+
+	for (i = 0; i < planes; i++) {
+		uint8_t *d = fb->map + fb->offsets[i];
+
+		for (y = 0; y < rows[i]; y++) {
+			memcpy(d, src, len[i]);
+			d += fb->pitches[i];
+			src += src_pitch[i];
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *video = "/dev/video0", *card = "/dev/dri/card0";
+	const struct format *f = &formats[0];
+	uint32_t w = 320, h = 240, frames = 300;
+	uint32_t crtc_id = 0, plane_id = 0, mode_w = 0, mode_h = 0, n;
+	struct v4l2_format fmt = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
+	struct v4l2_requestbuffers req = {
+		.count = NUM_CAPTURE,
+		.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		.memory = V4L2_MEMORY_MMAP,
+	};
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	struct drm_mode_set_plane set = { 0 };
+	void *capture[NUM_CAPTURE];
+	struct fb fbs[NUM_FBS];
+	int drm_fd, video_fd, opt, ret;
+	double start;
+	size_t i;
+
+	while ((opt = getopt(argc, argv, "v:d:f:s:n:")) != -1) {
+		switch (opt) {
+		case 'v':
+			video = optarg;
+			break;
+		case 'd':
+			card = optarg;
+			break;
+		case 'f':
+			for (i = 0; i < ARRAY_SIZE(formats); i++)
+				if (!strcmp(optarg, formats[i].name))
+					break;
+			if (i == ARRAY_SIZE(formats))
+				goto usage;
+			f = &formats[i];
+			break;
+		case 's':
+			if (sscanf(optarg, "%ux%u", &w, &h) != 2)
+				goto usage;
+			break;
+		case 'n':
+			frames = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc)
+		goto usage;
+
+	drm_fd = open(card, O_RDWR | O_CLOEXEC);
+	if (drm_fd < 0) {
+		perror(card);
+		return 1;
+	}
+	ret = find_overlay(drm_fd, &crtc_id, &plane_id, &mode_w, &mode_h);
+	if (ret) {
+		fprintf(stderr, "%s: no active CRTC with a YUV overlay plane: %s\n",
+			card, strerror(-ret));
+		return 1;
+	}
+
+	video_fd = open(video, O_RDWR | O_CLOEXEC);
+	if (video_fd < 0) {
+		perror(video);
+		return 1;
+	}
+
+	/* The device may round the size; show what it captures */
+	fmt.fmt.pix.width = w;
+	fmt.fmt.pix.height = h;
+	fmt.fmt.pix.pixelformat = f->v4l2;
+	fmt.fmt.pix.field = V4L2_FIELD_NONE;
+	if (ioctl(video_fd, VIDIOC_S_FMT, &fmt) ||
+	    fmt.fmt.pix.pixelformat != f->v4l2) {
+		fprintf(stderr, "%s: cannot capture %s\n", video, f->name);
+		return 1;
+	}
+	w = fmt.fmt.pix.width;
+	h = fmt.fmt.pix.height;
+
+	if (ioctl(video_fd, VIDIOC_REQBUFS, &req) || req.count > NUM_CAPTURE) {
+		perror("VIDIOC_REQBUFS");
+		return 1;
+	}
+	for (i = 0; i < req.count; i++) {
+		struct v4l2_buffer buf = {
+			.index = i,
+			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			.memory = V4L2_MEMORY_MMAP,
+		};
+
+		if (ioctl(video_fd, VIDIOC_QUERYBUF, &buf)) {
+			perror("VIDIOC_QUERYBUF");
+			return 1;
+		}
+		capture[i] = mmap(NULL, buf.length, PROT_READ, MAP_SHARED,
+				  video_fd, buf.m.offset);
+		if (capture[i] == MAP_FAILED || ioctl(video_fd, VIDIOC_QBUF, &buf)) {
+			perror(video);
+			return 1;
+		}
+	}
+
+	for (i = 0; i < NUM_FBS; i++) {
+		ret = fb_create(drm_fd, f, w, h, &fbs[i]);
+		if (ret) {
+			fprintf(stderr, "%s: dumb buffer: %s\n", card, strerror(-ret));
+			return 1;
+		}
+	}
+
+	/* As large as fits the mode, keeping the aspect ratio, centred */
+	set.plane_id = plane_id;
+	set.crtc_id = crtc_id;
+	set.crtc_w = mode_w;
+	set.crtc_h = (uint64_t)h * mode_w / w;
+	if (set.crtc_h > mode_h) {
+		set.crtc_h = mode_h;
+		set.crtc_w = (uint64_t)w * mode_h / h;
+	}
+	set.crtc_x = (mode_w - set.crtc_w) / 2;
+	set.crtc_y = (mode_h - set.crtc_h) / 2;
+	set.src_w = w << 16;
+	set.src_h = h << 16;
+
+	if (ioctl(video_fd, VIDIOC_STREAMON, &type)) {
+		perror("VIDIOC_STREAMON");
+		return 1;
+	}
+
+	printf("%s %ux%u %s -> plane %u at %ux%u+%d+%d of %ux%u\n", video, w, h,
+	       f->name, plane_id, set.crtc_w, set.crtc_h, set.crtc_x,
+	       set.crtc_y, mode_w, mode_h);
+
+	start = now_s();
+	for (n = 0; n < frames; n++) {
+		struct v4l2_buffer buf = {
+			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
+			.memory = V4L2_MEMORY_MMAP,
+		};
+		const struct fb *fb = &fbs[n % NUM_FBS];
+
+		if (ioctl(video_fd, VIDIOC_DQBUF, &buf)) {
+			perror("VIDIOC_DQBUF");
+			break;
+		}
+		fb_fill(fb, f, capture[buf.index], fmt.fmt.pix.bytesperline, w, h);
+		ioctl(video_fd, VIDIOC_QBUF, &buf);
+
+		set.fb_id = fb->id;
+		if (ioctl(drm_fd, DRM_IOCTL_MODE_SETPLANE, &set)) {
+			perror(errno == EACCES ? "SETPLANE (not DRM master?)" :
+			       "SETPLANE");
+			break;
+		}
+	}
+
+	if (n)
+		printf("%u frames, %.1f fps\n", n, n / (now_s() - start));
+
+	/* Take the overlay down again */
+	set.fb_id = 0;
+	ioctl(drm_fd, DRM_IOCTL_MODE_SETPLANE, &set);
+	ioctl(video_fd, VIDIOC_STREAMOFF, &type);
+	for (i = 0; i < NUM_FBS; i++)
+		ioctl(drm_fd, DRM_IOCTL_MODE_RMFB, &fbs[i].id);
+
+	return n == frames ? 0 : 1;
+
+usage:
+	fprintf(stderr, "usage: %s [-v /dev/videoN] [-d /dev/dri/cardN] [-f nv12|yuv420|grey] [-s WxH] [-n frames]\n",
+		argv[0]);
+	return 2;
+}